@@ -0,0 +1,217 @@
+/*
+ * ========
+ * EXAMPLE: Benchmark JSON Stream
+ * ========
+ *
+ * Description:
+ *   Measures how fast a response is parsed with and without the read-ahead
+ *   buffer that SpotifyESP::jsonStreamBlockSize controls. A canned currently
+ *   playing response is served by a mock client from RAM and parsed the same
+ *   way the library parses responses, once with a block size of 0, which
+ *   reads straight from the client, and once with the default.
+ *
+ *   No WiFi or Spotify account is needed. A real WiFiClientSecure pays for
+ *   its TLS record layer and locking on every call, set MOCK_CALL_COST_US to
+ *   what a read() costs on yours to see how much the buffer saves there.
+ *
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <SpotifyESP.h>   /* For SpotifyBufferedStream and the default block size. */
+
+#define BENCHMARK_ITERATIONS 200
+#define MOCK_CALL_COST_US 0   /* Added to every call into the mock client. */
+#define MOCK_RECORD_SIZE 1024 /* Bytes the mock says are available at once, like a decrypted TLS record. */
+
+static const char currentlyPlaying[] = R"json({
+  "device": {
+    "id": "0d1841b0976bae2a3a310dd74c0f3df354899bc8",
+    "is_active": true,
+    "is_private_session": false,
+    "is_restricted": false,
+    "name": "Living Room",
+    "type": "Speaker",
+    "volume_percent": 59,
+    "supports_volume": true
+  },
+  "repeat_state": "off",
+  "shuffle_state": false,
+  "context": {
+    "type": "album",
+    "href": "https://api.spotify.com/v1/albums/4aawyAB9vmqN3uQ7FjRGTy",
+    "external_urls": { "spotify": "https://open.spotify.com/album/4aawyAB9vmqN3uQ7FjRGTy" },
+    "uri": "spotify:album:4aawyAB9vmqN3uQ7FjRGTy"
+  },
+  "timestamp": 1700000000000,
+  "progress_ms": 83512,
+  "is_playing": true,
+  "item": {
+    "album": {
+      "album_type": "album",
+      "total_tracks": 12,
+      "available_markets": ["AD", "AE", "AR", "AT", "AU", "BE", "BG", "BR", "CA", "CH", "CL", "CO", "CZ", "DE", "DK", "ES", "FI", "FR", "GB", "IE", "IT", "JP", "MX", "NL", "NO", "NZ", "PL", "PT", "SE", "US"],
+      "external_urls": { "spotify": "https://open.spotify.com/album/4aawyAB9vmqN3uQ7FjRGTy" },
+      "href": "https://api.spotify.com/v1/albums/4aawyAB9vmqN3uQ7FjRGTy",
+      "id": "4aawyAB9vmqN3uQ7FjRGTy",
+      "images": [
+        { "url": "https://i.scdn.co/image/ab67616d0000b2732c5b24ecfa39523a75c993c4", "height": 640, "width": 640 },
+        { "url": "https://i.scdn.co/image/ab67616d00001e022c5b24ecfa39523a75c993c4", "height": 300, "width": 300 },
+        { "url": "https://i.scdn.co/image/ab67616d000048512c5b24ecfa39523a75c993c4", "height": 64, "width": 64 }
+      ],
+      "name": "Global Warming",
+      "release_date": "2012-11-16",
+      "release_date_precision": "day",
+      "type": "album",
+      "uri": "spotify:album:4aawyAB9vmqN3uQ7FjRGTy",
+      "artists": [
+        {
+          "external_urls": { "spotify": "https://open.spotify.com/artist/0TnOYISbd1XYRBk9myaseg" },
+          "href": "https://api.spotify.com/v1/artists/0TnOYISbd1XYRBk9myaseg",
+          "id": "0TnOYISbd1XYRBk9myaseg",
+          "name": "Pitbull",
+          "type": "artist",
+          "uri": "spotify:artist:0TnOYISbd1XYRBk9myaseg"
+        }
+      ]
+    },
+    "artists": [
+      {
+        "external_urls": { "spotify": "https://open.spotify.com/artist/0TnOYISbd1XYRBk9myaseg" },
+        "href": "https://api.spotify.com/v1/artists/0TnOYISbd1XYRBk9myaseg",
+        "id": "0TnOYISbd1XYRBk9myaseg",
+        "name": "Pitbull",
+        "type": "artist",
+        "uri": "spotify:artist:0TnOYISbd1XYRBk9myaseg"
+      },
+      {
+        "external_urls": { "spotify": "https://open.spotify.com/artist/7bXgB6jMjp9ATFy66eO08Z" },
+        "href": "https://api.spotify.com/v1/artists/7bXgB6jMjp9ATFy66eO08Z",
+        "id": "7bXgB6jMjp9ATFy66eO08Z",
+        "name": "Chris Brown",
+        "type": "artist",
+        "uri": "spotify:artist:7bXgB6jMjp9ATFy66eO08Z"
+      }
+    ],
+    "available_markets": ["AD", "AE", "AR", "AT", "AU", "BE", "BG", "BR", "CA", "CH", "CL", "CO", "CZ", "DE", "DK", "ES", "FI", "FR", "GB", "IE", "IT", "JP", "MX", "NL", "NO", "NZ", "PL", "PT", "SE", "US"],
+    "disc_number": 1,
+    "duration_ms": 207959,
+    "explicit": false,
+    "external_ids": { "isrc": "USJAY1200103" },
+    "external_urls": { "spotify": "https://open.spotify.com/track/6OmhkSOpvYBokMKQxpIGx2" },
+    "href": "https://api.spotify.com/v1/tracks/6OmhkSOpvYBokMKQxpIGx2",
+    "id": "6OmhkSOpvYBokMKQxpIGx2",
+    "is_local": false,
+    "name": "International Love (feat. Chris Brown)",
+    "popularity": 76,
+    "preview_url": null,
+    "track_number": 3,
+    "type": "track",
+    "uri": "spotify:track:6OmhkSOpvYBokMKQxpIGx2"
+  },
+  "currently_playing_type": "track",
+  "actions": { "disallows": { "resuming": true, "skipping_prev": true } }
+})json";
+
+/* Serves a fixed body from RAM, the way a connected client would. */
+class MockClient : public Client {
+public:
+    MockClient(const char *body, size_t length) : _body((const uint8_t*)body), _length(length), _position(0) {}
+
+    void rewind() { _position = 0; }
+    uint32_t calls() const { return _calls; }
+
+    int connect(IPAddress, uint16_t) override { return 1; }
+    int connect(const char*, uint16_t) override { return 1; }
+    size_t write(uint8_t) override { return 0; }
+    size_t write(const uint8_t*, size_t) override { return 0; }
+    void flush() override {}
+    void stop() override {}
+    uint8_t connected() override { return _position < _length; }
+    operator bool() override { return true; }
+
+    int available() override
+    {
+        call();
+        return min(_length - _position, (size_t)MOCK_RECORD_SIZE);
+    }
+
+    int read() override
+    {
+        call();
+        return _position < _length ? _body[_position++] : -1;
+    }
+
+    int read(uint8_t *buffer, size_t length) override
+    {
+        call();
+        size_t amount = min(length, _length - _position);
+        memcpy(buffer, _body + _position, amount);
+        _position += amount;
+        return amount;
+    }
+
+    int peek() override
+    {
+        call();
+        return _position < _length ? _body[_position] : -1;
+    }
+
+private:
+    void call()
+    {
+        _calls++;
+        if (MOCK_CALL_COST_US)
+            delayMicroseconds(MOCK_CALL_COST_US);
+    }
+
+    const uint8_t *_body;
+    size_t _length;
+    size_t _position;
+    uint32_t _calls = 0;
+};
+
+MockClient client(currentlyPlaying, sizeof(currentlyPlaying) - 1);
+DynamicJsonDocument doc(8192);
+
+/* Parses the response over and over with the given block size, like SpotifyESP does. */
+static void benchmark(size_t blockSize)
+{
+    uint32_t callsBefore = client.calls();
+    unsigned long start = micros();
+
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        client.rewind();
+        SpotifyBufferedStream stream(client, blockSize);
+
+        DeserializationError error = deserializeJson(doc, stream);
+        if (error)
+        {
+            Serial.printf("Block size %u: parse failed, %s\n", (unsigned)blockSize, error.c_str());
+            return;
+        }
+    }
+
+    unsigned long elapsed = micros() - start;
+    uint32_t calls = client.calls() - callsBefore;
+    double bytes = (double)(sizeof(currentlyPlaying) - 1) * BENCHMARK_ITERATIONS;
+
+    Serial.printf("Block size %4u: %8.0f bytes/s, %lu us per response, %lu client calls per response\n",
+        (unsigned)blockSize, bytes * 1e6 / elapsed, elapsed / BENCHMARK_ITERATIONS, calls / BENCHMARK_ITERATIONS);
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    delay(1000);
+
+    Serial.printf("Parsing a %u byte response %d times\n", (unsigned)(sizeof(currentlyPlaying) - 1), BENCHMARK_ITERATIONS);
+
+    benchmark(0);                         /* jsonStreamBlockSize = 0, unbuffered. */
+    benchmark(SPOTIFY_STREAM_BLOCK_SIZE); /* The default. */
+}
+
+void loop()
+{
+}
@@ -0,0 +1,106 @@
+#include "SpotifyBufferedStream.h"
+
+SpotifyBufferedStream::SpotifyBufferedStream(Client &source, size_t blockSize)
+    : _source(source)
+    , _buffer(blockSize ? (uint8_t*)malloc(blockSize) : nullptr)
+    , _blockSize(blockSize)
+    , _position(0)
+    , _length(0)
+    , _received(0)
+{
+    setTimeout(SPOTIFY_TIMEOUT);
+
+    if (!_buffer && blockSize)
+        log_w("Could not allocate a %d byte read buffer, reading unbuffered", blockSize);
+}
+
+SpotifyBufferedStream::~SpotifyBufferedStream()
+{
+    free(_buffer);
+}
+
+int SpotifyBufferedStream::available()
+{
+    return (_length - _position) + _source.available();
+}
+
+int SpotifyBufferedStream::read()
+{
+    if (!_buffer)
+    {
+        int c = _source.read();
+        if (c >= 0)
+            _received++;
+        return c;
+    }
+
+    if (_position >= _length && !fill())
+        return -1;
+
+    return _buffer[_position++];
+}
+
+int SpotifyBufferedStream::peek()
+{
+    if (!_buffer)
+        return _source.peek();
+
+    if (_position >= _length && !fill())
+        return -1;
+
+    return _buffer[_position];
+}
+
+size_t SpotifyBufferedStream::readBytes(char *buffer, size_t length)
+{
+    size_t copied = 0;
+
+    while (copied < length)
+    {
+        if (!_buffer)
+        {
+            int c = timedRead();
+            if (c < 0)
+                break;
+
+            buffer[copied++] = (char)c;
+            continue;
+        }
+
+        if (_position >= _length && !fill())
+            break;
+
+        size_t amount = min(length - copied, _length - _position);
+        memcpy(buffer + copied, _buffer + _position, amount);
+        _position += amount;
+        copied += amount;
+    }
+
+    return copied;
+}
+
+bool SpotifyBufferedStream::fill()
+{
+    _position = 0;
+    _length = 0;
+
+    /* Wait for the next record to arrive, giving up when the peer closes or we time out. */
+    unsigned long start = millis();
+    while (_source.available() <= 0)
+    {
+        if (!_source.connected() || millis() - start >= _timeout)
+            return false;
+
+        delay(1);
+    }
+
+    /* Take everything already decrypted in one read, up to a block. */
+    size_t amount = min((size_t)_source.available(), _blockSize);
+    int received = _source.read(_buffer, amount);
+    if (received <= 0)
+        return false;
+
+    _length = received;
+    _received += received;
+    return true;
+}
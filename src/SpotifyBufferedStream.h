@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include "SpotifyConfig.h"
+
+/** @brief Reads ahead from a client in blocks.
+ *
+ * ArduinoJson pulls a response one byte at a time, and every read from a
+ * WiFiClientSecure goes through the TLS record layer and its locking. This
+ * wraps the client and reads whole blocks of whatever has already been
+ * decrypted, so the parser reads from memory most of the time.
+ *
+ * With a block size of 0, or if the block can't be allocated, reads are
+ * passed straight to the client.
+ *
+ */
+class SpotifyBufferedStream : public Stream {
+public:
+    SpotifyBufferedStream(Client &source, size_t blockSize = SPOTIFY_STREAM_BLOCK_SIZE);
+    ~SpotifyBufferedStream();
+
+    SpotifyBufferedStream(const SpotifyBufferedStream&) = delete;
+    SpotifyBufferedStream& operator=(const SpotifyBufferedStream&) = delete;
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+    /** @brief Bytes taken from the client so far, including any still in the block. */
+    size_t received() const { return _received; }
+
+    /* Responses are only read, writing does nothing. */
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+private:
+    bool fill();
+
+    Client &_source;
+    uint8_t *_buffer;
+    size_t _blockSize;
+    size_t _position;
+    size_t _length;
+    size_t _received;
+};
@@ -27,6 +27,15 @@
 #define SPOTIFY_PREVIOUS_TRACK_ENDPOINT "/v1/me/player/previous"
 #define SPOTIFY_SEEK_ENDPOINT "/v1/me/player/seek"
 #define SPOTIFY_TOKEN_ENDPOINT  "/api/token"
+#define SPOTIFY_TRACKS_ENDPOINT "/v1/tracks?ids="
+#define SPOTIFY_ALBUMS_ENDPOINT "/v1/albums?ids="
+#define SPOTIFY_ARTISTS_ENDPOINT "/v1/artists?ids="
+#define SPOTIFY_SAVED_TRACKS_ENDPOINT "/v1/me/tracks?"
+#define SPOTIFY_USER_PLAYLISTS_ENDPOINT "/v1/me/playlists?"
+#define SPOTIFY_RECENTLY_PLAYED_ENDPOINT "/v1/me/player/recently-played?limit=%d&after=%llu"
+#define SPOTIFY_QUEUE_ENDPOINT "/v1/me/player/queue"
+#define SPOTIFY_LIBRARY_TRACKS_ENDPOINT "/v1/me/tracks"
+#define SPOTIFY_USER_PROFILE_ENDPOINT "/v1/me"
 
 #define SPOTIFY_TIMEOUT 2000
 
@@ -41,3 +50,56 @@
 #define SPOTIFY_DEVICE_TYPE_CHAR_LENGTH 30
 #define SPOTIFY_NUM_ALBUM_IMAGES 3 // Max spotify returns is 3, but the third one is probably too big for an ESP
 #define SPOTIFY_MAX_NUM_ARTISTS 5
+
+#define SPOTIFY_HOST_CHAR_LENGTH 64
+#define SPOTIFY_MAX_CONNECTIONS 3 // One for each host we talk to: api, accounts and the image server
+#define SPOTIFY_MAX_TLS_SESSIONS 2 // Each mbedTLS session holds its own record buffers, keep this low
+#define SPOTIFY_TLS_SESSION_HEAP 45000 // Rough amount of free heap needed before opening another TLS session
+#define SPOTIFY_WARM_IDLE_TIMEOUT 15000 // How long a pre-warmed connection stays open without being used
+#define SPOTIFY_DNS_CACHE_ENTRIES 4 // api, accounts and a couple of image CDN hosts
+#define SPOTIFY_DNS_TTL 300000 // Addresses are trusted for this long before being refreshed
+#define SPOTIFY_DNS_STALE_TTL 3600000 // Expired addresses are still served this long while a refresh runs
+#define SPOTIFY_STREAM_BLOCK_SIZE 512 // Bytes read from TLS at once while parsing JSON responses
+#define SPOTIFY_INFLATE_INPUT_SIZE 512 // Compressed bytes handed to the inflater at once
+#define SPOTIFY_IMAGE_CACHE_ENTRIES 32 // Album covers indexed by the flash image cache
+#define SPOTIFY_IMAGE_CACHE_BUDGET (512 * 1024) // Bytes of flash the image cache may use
+#define SPOTIFY_IMAGE_CACHE_DIRECTORY "/spotify"
+#define SPOTIFY_IMAGE_READ_LENGTH 128 // Bytes of an image read at once when the image block can't be allocated
+#define SPOTIFY_IMAGE_MEMORY_ENTRIES 8 // Album covers kept in RAM by the memory image cache
+#define SPOTIFY_IMAGE_MEMORY_BUCKETS 16 // Hash buckets of the memory image cache, a power of two
+#define SPOTIFY_IMAGE_MEMORY_BUDGET (256 * 1024) // Bytes of RAM the memory image cache may use, PSRAM when there is some
+#define SPOTIFY_IMAGE_BLOCK_SIZE 4096 // Bytes of an image read at once, allocated per download
+#define SPOTIFY_IMAGE_PIPELINE_SLOTS 4 // Blocks in flight between the download and the decoder
+#define SPOTIFY_IMAGE_PIPELINE_STACK 8192 // Stack of the decoder task, JPEG decoders need a fair bit
+#define SPOTIFY_PREFETCH_IMAGES 4 // Upcoming album covers waiting to be fetched in idle time
+#define SPOTIFY_IMAGE_RESUME_ATTEMPTS 3 // Range requests sent to finish an image after the connection drops
+#define SPOTIFY_MAX_TRACKS_PER_REQUEST 50 // Spotify's limit for /v1/tracks
+#define SPOTIFY_MAX_ALBUMS_PER_REQUEST 20 // Spotify's limit for /v1/albums
+#define SPOTIFY_MAX_ARTISTS_PER_REQUEST 50 // Spotify's limit for /v1/artists
+#define SPOTIFY_ID_CHAR_LENGTH 23 // Base62 ids are 22 characters
+#define SPOTIFY_SNAPSHOT_ID_CHAR_LENGTH 64
+#define SPOTIFY_MAX_PLAYLIST_ITEMS_PER_PAGE 100 // Spotify's limit for playlist items
+#define SPOTIFY_MAX_LIBRARY_ITEMS_PER_PAGE 50 // Spotify's limit for saved tracks and playlists
+#define SPOTIFY_PAGE_PREFETCH_STACK 8192 // Stack of the task fetching the next page, it may do a TLS handshake
+#define SPOTIFY_LIBRARY_PAGE_SIZE 20 // Items requested per page, each page of tracks takes about 1.2KB per item
+#define SPOTIFY_PLAYLIST_SYNC_DIRECTORY "/spotify"
+#define SPOTIFY_MAX_RECENTLY_PLAYED 50 // Spotify's limit for recently played tracks
+#define SPOTIFY_LISTENING_LOG_ENTRIES 128 // Plays kept by the listening log before the oldest are overwritten
+#define SPOTIFY_LISTENING_LOG_PATH "/spotify/played.bin"
+#define SPOTIFY_MAX_QUEUE_ITEMS 20 // Queued items remembered for diffing, Spotify sends up to 20
+#define SPOTIFY_MAX_SEARCH_RESULTS 50 // Spotify's limit per type for /v1/search
+#define SPOTIFY_SEARCH_CACHE_ENTRIES 8 // Searches kept by the search cache
+#define SPOTIFY_SEARCH_CACHE_BUDGET (32 * 1024) // Bytes of RAM the search cache may use, PSRAM when there is some
+#define SPOTIFY_SEARCH_CACHE_TTL 300000 // Cached search results are used for this long
+#define SPOTIFY_SEARCH_RECORD_SIZE 8192 // Largest packed search response that will be cached
+#define SPOTIFY_SEARCH_PATH_LENGTH 256 // Search request path a query builder holds in its own buffer, about 70 characters go to anything but the terms
+#define SPOTIFY_BODY_CHUNK_SIZE 256 // Bytes of a request body written out at once, larger bodies are written in several passes
+#define SPOTIFY_MAX_SAVED_TRACKS_PER_REQUEST 50 // Spotify's limit for saving and removing library tracks
+#define SPOTIFY_DEVICE_REGISTRY_ENTRIES 8 // Devices the registry remembers, the one heard of longest ago goes first
+#define SPOTIFY_DEVICE_REGISTRY_BUCKETS 16 // Hash buckets for each of the name and id lookups, a power of two
+#define SPOTIFY_DEVICE_REGISTRY_TTL 300000 // The device list is fetched again when a lookup misses and it's older than this
+#define SPOTIFY_REFRESH_TOKEN_LENGTH 256 // Longest refresh token the credential store keeps, Spotify's are about 130 characters
+#define SPOTIFY_CREDENTIAL_NAMESPACE "spotify" // NVS namespace of the credential store
+#define SPOTIFY_CREDENTIAL_PATH "/spotify/credentials.bin"
+#define SPOTIFY_CLOCK_VALID_AFTER 1577836800 // Wall clock times before 2020 mean SNTP hasn't set the time yet
+#define SPOTIFY_DRAIN_LIMIT 4096 // Unread response bytes skipped to keep a warm socket, closing it is cheaper past this
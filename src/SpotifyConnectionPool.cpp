@@ -0,0 +1,297 @@
+#include <new>
+
+#include "SpotifyConnectionPool.h"
+#include "SpotifyCert.h"
+
+/* The API and accounts servers share a root certificate, anything else is the image CDN. */
+const char* SpotifyConnectionPool::certificateFor(const char *host)
+{
+    const char *suffix = "spotify.com";
+    size_t hostLength = strlen(host);
+    size_t suffixLength = strlen(suffix);
+
+    if (hostLength >= suffixLength && strcmp(host + hostLength - suffixLength, suffix) == 0)
+        return SpotifyCert::server;
+
+    return SpotifyCert::imageServer;
+}
+
+SpotifyConnectionPool::SpotifyConnectionPool()
+    : _connections()
+    , _count(0)
+{
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+}
+
+SpotifyConnectionPool::~SpotifyConnectionPool()
+{
+    for (int i = 0; i < _count; i++)
+    {
+        SpotifyConnection &connection = _connections[i];
+        if (!connection.owned)
+            continue;
+
+        connection.httpClient->end();
+        connection.wifiClient->stop();
+        delete connection.httpClient;
+        delete connection.wifiClient;
+    }
+}
+
+bool SpotifyConnectionPool::add(WiFiClientSecure &wifiClient, HTTPClient &httpClient)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    bool added = false;
+    if (_count < SPOTIFY_MAX_CONNECTIONS)
+    {
+        SpotifyConnection &connection = _connections[_count++];
+        connection.wifiClient = &wifiClient;
+        connection.httpClient = &httpClient;
+        connection.host[0] = '\0';
+        connection.inUse = false;
+        connection.owned = false;
+        connection.keepAlive = false;
+        connection.bodyRead = false;
+        connection.idleTimeoutMs = 0;
+        connection.lastUsedMs = 0;
+        added = true;
+    }
+
+    xSemaphoreGive(_mutex);
+
+    if (!added)
+        log_e("Connection pool is full, increase SPOTIFY_MAX_CONNECTIONS.");
+
+    return added;
+}
+
+SpotifyConnection* SpotifyConnectionPool::acquire(const char *host)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    SpotifyConnection *chosen = nullptr;
+
+    /* Warm connections that sat idle for too long aren't worth reusing. */
+    expireIdle();
+
+    /* An idle connection that is already talking to this host. */
+    for (int i = 0; i < _count && !chosen; i++)
+        if (!_connections[i].inUse && strcmp(_connections[i].host, host) == 0)
+            chosen = &_connections[i];
+
+    /* An idle connection that isn't holding a session open. */
+    for (int i = 0; i < _count && !chosen; i++)
+        if (!_connections[i].inUse && !_connections[i].wifiClient->connected())
+            chosen = &_connections[i];
+
+    /* Allocate a new client pair when the heap can take another session. */
+    if (!chosen && allowAllocation && _count < SPOTIFY_MAX_CONNECTIONS && ESP.getFreeHeap() >= minFreeHeap)
+    {
+        WiFiClientSecure *wifiClient = new (std::nothrow) WiFiClientSecure();
+        HTTPClient *httpClient = new (std::nothrow) HTTPClient();
+
+        if (wifiClient && httpClient)
+        {
+            chosen = &_connections[_count++];
+            chosen->wifiClient = wifiClient;
+            chosen->httpClient = httpClient;
+            chosen->host[0] = '\0';
+            chosen->owned = true;
+            chosen->keepAlive = false;
+            chosen->bodyRead = false;
+            log_d("Allocated connection %d for %s", _count, host);
+        }
+        else
+        {
+            delete wifiClient;
+            delete httpClient;
+        }
+    }
+
+    /* Steal the connection that has been idle the longest. */
+    if (!chosen)
+        chosen = findLeastRecentlyUsedIdle(nullptr, false);
+
+    if (chosen && !(strcmp(chosen->host, host) == 0 && chosen->wifiClient->connected()))
+    {
+        /* A new TLS session will be opened, make sure there is room for it. */
+        if (chosen->wifiClient->connected())
+            chosen->wifiClient->stop();
+
+        makeRoomForSession(chosen);
+
+        int sessions = openSessions();
+        if (sessions > 0 && (sessions >= maxSessions || ESP.getFreeHeap() < minFreeHeap))
+        {
+            log_w("Not enough heap for another TLS session to %s (%d open)", host, sessions);
+            chosen = nullptr;
+        }
+        else
+        {
+            bind(chosen, host);
+        }
+    }
+
+    if (chosen)
+    {
+        chosen->inUse = true;
+        chosen->lastUsedMs = millis();
+    }
+
+    xSemaphoreGive(_mutex);
+    return chosen;
+}
+
+bool SpotifyConnectionPool::connect(SpotifyConnection *connection)
+{
+    if (connection->wifiClient->connected())
+        return true;
+
+    if (!useDnsCache)
+        return connection->wifiClient->connect(connection->host, 443);
+
+    IPAddress address;
+    if (!_dns.resolve(connection->host, address))
+        return false;
+
+    const char *certificate = certificateFor(connection->host);
+    if (connection->wifiClient->connect(address, 443, connection->host, certificate, NULL, NULL))
+        return true;
+
+    /* The host may have moved while we held on to its old address, look it up once more. */
+    log_w("Could not connect to %s at %s, resolving it again", connection->host, address.toString().c_str());
+    _dns.invalidate(connection->host);
+
+    IPAddress resolved;
+    if (!_dns.resolve(connection->host, resolved) || resolved == address)
+        return false;
+
+    return connection->wifiClient->connect(resolved, 443, connection->host, certificate, NULL, NULL);
+}
+
+void SpotifyConnectionPool::release(SpotifyConnection *connection)
+{
+    if (!connection)
+        return;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    connection->inUse = false;
+    connection->lastUsedMs = millis();
+    xSemaphoreGive(_mutex);
+}
+
+void SpotifyConnectionPool::closeIdle()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    for (int i = 0; i < _count; i++)
+        if (!_connections[i].inUse && _connections[i].wifiClient->connected())
+            _connections[i].wifiClient->stop();
+
+    xSemaphoreGive(_mutex);
+}
+
+bool SpotifyConnectionPool::warm(const char *host, unsigned long idleTimeoutMs)
+{
+    SpotifyConnection *connection = acquire(host);
+    if (!connection)
+        return false;
+
+    log_d("Warming connection to %s", host);
+    bool connected = connect(connection);
+
+    if (connected)
+    {
+        connection->keepAlive = true;
+        connection->idleTimeoutMs = idleTimeoutMs;
+    }
+
+    release(connection);
+    return connected;
+}
+
+void SpotifyConnectionPool::closeExpired()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    expireIdle();
+    xSemaphoreGive(_mutex);
+}
+
+void SpotifyConnectionPool::expireIdle()
+{
+    unsigned long now = millis();
+    for (int i = 0; i < _count; i++)
+    {
+        SpotifyConnection &connection = _connections[i];
+        if (connection.inUse || !connection.keepAlive)
+            continue;
+
+        if (now - connection.lastUsedMs >= connection.idleTimeoutMs)
+        {
+            log_d("Warm connection to %s expired", connection.host);
+            connection.keepAlive = false;
+            connection.wifiClient->stop();
+        }
+    }
+}
+
+int SpotifyConnectionPool::openSessions()
+{
+    int sessions = 0;
+    for (int i = 0; i < _count; i++)
+        if (_connections[i].wifiClient->connected())
+            sessions++;
+
+    return sessions;
+}
+
+SpotifyDnsCache& SpotifyConnectionPool::getDnsCache()
+{
+    return _dns;
+}
+
+SpotifyConnection* SpotifyConnectionPool::findLeastRecentlyUsedIdle(const SpotifyConnection *except, bool connectedOnly)
+{
+    SpotifyConnection *oldest = nullptr;
+    unsigned long now = millis();
+
+    for (int i = 0; i < _count; i++)
+    {
+        SpotifyConnection *connection = &_connections[i];
+        if (connection == except || connection->inUse)
+            continue;
+
+        if (connectedOnly && !connection->wifiClient->connected())
+            continue;
+
+        if (!oldest || (now - connection->lastUsedMs) > (now - oldest->lastUsedMs))
+            oldest = connection;
+    }
+
+    return oldest;
+}
+
+void SpotifyConnectionPool::makeRoomForSession(const SpotifyConnection *except)
+{
+    while (openSessions() >= maxSessions || ESP.getFreeHeap() < minFreeHeap)
+    {
+        SpotifyConnection *victim = findLeastRecentlyUsedIdle(except, true);
+        if (!victim)
+            break;
+
+        log_d("Closing idle connection to %s to make room", victim->host);
+        victim->wifiClient->stop();
+    }
+}
+
+void SpotifyConnectionPool::bind(SpotifyConnection *connection, const char *host)
+{
+    strncpy(connection->host, host, sizeof(connection->host)-1);
+    connection->host[sizeof(connection->host)-1] = '\0';
+    connection->keepAlive = false;
+
+    /* Any client can be rebound to another host, yours included, so they all
+     * get the certificate of the host they now talk to. */
+    connection->wifiClient->setCACert(certificateFor(host));
+}
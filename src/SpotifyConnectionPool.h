@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "SpotifyConfig.h"
+#include "SpotifyDnsCache.h"
+
+/** @brief A secure client and its HTTP client, bound to one host at a time. */
+struct SpotifyConnection {
+    WiFiClientSecure *wifiClient;
+    HTTPClient *httpClient;
+    char host[SPOTIFY_HOST_CHAR_LENGTH]; /** @brief Host the client is currently bound to, empty if none. */
+    bool inUse; /** @brief A request is in flight or its response hasn't been read yet. */
+    bool owned; /** @brief The pool allocated the clients and will delete them. */
+    bool keepAlive; /** @brief Connection was warmed, keep the socket open between requests. */
+    bool bodyRead; /** @brief The last response was read to its end, so the socket can carry another request. */
+    unsigned long idleTimeoutMs; /** @brief A kept alive connection is closed after being idle this long. */
+    unsigned long lastUsedMs;
+};
+
+/** @brief A small set of client connections, one per host.
+ *
+ * Requests to different hosts (api.spotify.com, accounts.spotify.com and the
+ * image CDN) each get their own connection so an image download can stay in
+ * flight while the API is polled. Every open TLS session costs a big chunk
+ * of heap, so the pool caps how many are open at once and closes idle ones
+ * before opening a new one when the heap runs low.
+ *
+ * Acquiring and releasing is guarded by a mutex, so it's fine to download
+ * images from one task while another task controls the player.
+ *
+ */
+class SpotifyConnectionPool {
+public:
+    SpotifyConnectionPool();
+    ~SpotifyConnectionPool();
+
+    SpotifyConnectionPool(const SpotifyConnectionPool&) = delete;
+    SpotifyConnectionPool& operator=(const SpotifyConnectionPool&) = delete;
+
+    /** @brief Adds your own client pair to the pool.
+     *
+     * The clients must outlive the pool. Like the pool's own clients they
+     * can be rebound to any Spotify host, so the pool sets the certificate
+     * from @ref certificateFor on them whenever it does.
+     *
+     * @return True on -- there was room in the pool for the connection.
+     */
+    bool add(WiFiClientSecure &wifiClient, HTTPClient &httpClient);
+
+    /** @brief Gets a connection for a host and marks it as in use.
+     *
+     * Prefers an idle connection already bound to the host, then an unused
+     * one, then allocates a new client pair if allowed and the heap allows
+     * it. As a last resort the least recently used idle connection is closed
+     * and rebound to the host.
+     *
+     * @param[in] host The host the request will go to.
+     *
+     * @return NULL on -- every connection is busy or there isn't heap for another TLS session.
+     */
+    SpotifyConnection* acquire(const char *host);
+
+    /** @brief Opens the TLS session of a connection if it isn't open already.
+     *
+     * The host is resolved through the DNS cache and the session is opened
+     * to that address, with the host name still used for SNI and checking
+     * the certificate. The root certificate from @ref certificateFor is used.
+     *
+     * @return True on -- the connection is open.
+     */
+    bool connect(SpotifyConnection *connection);
+
+    /** @brief Gives a connection back to the pool, call after HTTPClient::end(). */
+    void release(SpotifyConnection *connection);
+
+    /** @brief Closes every connection that isn't currently in use. */
+    void closeIdle();
+
+    /** @brief Opens a connection to a host ahead of time and keeps it open.
+     * 
+     * DNS, TCP and the TLS handshake are done now instead of when the next
+     * request is sent. Requests on the connection then keep the socket
+     * alive until it has been idle for longer than the timeout.
+     * 
+     * @param[in] host The host to connect to.
+     * @param[in] idleTimeoutMs Closes the connection after being idle this long.
+     * 
+     * @return True on -- the connection is open.
+     */
+    bool warm(const char *host, unsigned long idleTimeoutMs);
+
+    /** @brief Closes warmed connections that have been idle past their timeout. */
+    void closeExpired();
+
+    /** @brief The number of TLS sessions currently open. */
+    int openSessions();
+
+    /** @brief The cache every connection resolves its host through. */
+    SpotifyDnsCache& getDnsCache();
+
+    /** @brief The root certificate that Spotify's servers use for a host. */
+    static const char* certificateFor(const char *host);
+
+    int maxSessions = SPOTIFY_MAX_TLS_SESSIONS; /** @brief Open TLS sessions are capped at this amount. */
+    size_t minFreeHeap = SPOTIFY_TLS_SESSION_HEAP; /** @brief Heap needed before another TLS session is opened. */
+    bool allowAllocation = true; /** @brief Allocates new clients when none of yours are free. */
+    bool useDnsCache = true; /** @brief Connect through the DNS cache instead of resolving on every connection. */
+
+private:
+    SpotifyConnection* findLeastRecentlyUsedIdle(const SpotifyConnection *except, bool connectedOnly);
+    void makeRoomForSession(const SpotifyConnection *except);
+    void expireIdle();
+    void bind(SpotifyConnection *connection, const char *host);
+
+    SpotifyConnection _connections[SPOTIFY_MAX_CONNECTIONS];
+    int _count;
+    SpotifyDnsCache _dns;
+    SemaphoreHandle_t _mutex;
+    StaticSemaphore_t _mutexBuffer;
+};
@@ -0,0 +1,145 @@
+#include "SpotifyCredentialStore.h"
+
+#define SPOTIFY_CREDENTIAL_MAGIC 0x52435053 // "SPCR"
+
+/* Saved as one blob, the checksum catches a save that didn't finish. */
+struct SpotifyCredentialRecord {
+    uint32_t magic;
+    uint32_t checksum;
+    SpotifyCredentials credentials;
+};
+
+/* FNV-1a over the whole struct. */
+static uint32_t checksum(const SpotifyCredentials &credentials)
+{
+    const uint8_t *bytes = (const uint8_t*)&credentials;
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(credentials); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool unpack(const SpotifyCredentialRecord &record, SpotifyCredentials &credentials)
+{
+    if (record.magic != SPOTIFY_CREDENTIAL_MAGIC || record.checksum != checksum(record.credentials))
+        return false;
+
+    credentials = record.credentials;
+
+    /* Never trust the terminators of something read back from flash. */
+    credentials.accessToken[sizeof(credentials.accessToken)-1] = '\0';
+    credentials.refreshToken[sizeof(credentials.refreshToken)-1] = '\0';
+    return true;
+}
+
+bool SpotifyNvsCredentialStore::load(SpotifyCredentials &credentials)
+{
+    Preferences preferences;
+    if (!preferences.begin(_name, true))
+        return false;
+
+    SpotifyCredentialRecord record;
+    bool valid = preferences.getBytes("tokens", &record, sizeof(record)) == sizeof(record)
+              && unpack(record, credentials);
+
+    preferences.end();
+    return valid;
+}
+
+bool SpotifyNvsCredentialStore::save(const SpotifyCredentials &credentials)
+{
+    Preferences preferences;
+    if (!preferences.begin(_name, false))
+    {
+        log_e("Could not open the %s namespace", _name);
+        return false;
+    }
+
+    SpotifyCredentialRecord record;
+    record.magic = SPOTIFY_CREDENTIAL_MAGIC;
+    record.credentials = credentials;
+    record.checksum = checksum(record.credentials);
+
+    bool saved = preferences.putBytes("tokens", &record, sizeof(record)) == sizeof(record);
+    preferences.end();
+    return saved;
+}
+
+void SpotifyNvsCredentialStore::clear()
+{
+    Preferences preferences;
+    if (!preferences.begin(_name, false))
+        return;
+
+    preferences.remove("tokens");
+    preferences.end();
+}
+
+bool SpotifyFileCredentialStore::load(SpotifyCredentials &credentials)
+{
+    /* A save cut off after the old file was removed leaves only the new one. */
+    return read(_path, credentials) || read(String(_path) + ".tmp", credentials);
+}
+
+bool SpotifyFileCredentialStore::save(const SpotifyCredentials &credentials)
+{
+    /* Make sure the directory the file lives in exists. */
+    const char *slash = strrchr(_path, '/');
+    if (slash && slash != _path)
+    {
+        char directory[48];
+        snprintf(directory, min(sizeof(directory), (size_t)(slash - _path + 1)), "%s", _path);
+        _fs.mkdir(directory);
+    }
+
+    SpotifyCredentialRecord record;
+    record.magic = SPOTIFY_CREDENTIAL_MAGIC;
+    record.credentials = credentials;
+    record.checksum = checksum(record.credentials);
+
+    String temporaryPath = String(_path) + ".tmp";
+    fs::File file = _fs.open(temporaryPath, FILE_WRITE);
+    if (!file)
+    {
+        log_e("Could not create %s", temporaryPath.c_str());
+        return false;
+    }
+
+    bool written = file.write((const uint8_t*)&record, sizeof(record)) == sizeof(record);
+    file.close();
+
+    if (!written)
+    {
+        _fs.remove(temporaryPath);
+        return false;
+    }
+
+    /* Not every file system renames over an existing file. */
+    _fs.remove(_path);
+    return _fs.rename(temporaryPath, _path);
+}
+
+void SpotifyFileCredentialStore::clear()
+{
+    _fs.remove(_path);
+    _fs.remove(String(_path) + ".tmp");
+}
+
+bool SpotifyFileCredentialStore::read(const String &path, SpotifyCredentials &credentials)
+{
+    fs::File file = _fs.open(path, FILE_READ);
+    if (!file)
+        return false;
+
+    SpotifyCredentialRecord record;
+    bool valid = file.read((uint8_t*)&record, sizeof(record)) == sizeof(record)
+              && unpack(record, credentials);
+
+    file.close();
+    return valid;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <Preferences.h>
+
+#include "SpotifyConfig.h"
+#include "SpotifyStructs.h"
+
+/** @brief Keeps the tokens across reboots, for @ref SpotifyESP::setCredentialStore.
+ *
+ * Spotify may hand out a new refresh token with every access token, and the
+ * old one stops working. Saving them as they arrive means a reboot can't
+ * lose them, and a reboot within the access token's lifetime doesn't have
+ * to refresh at all. Implement this to keep them somewhere else.
+ *
+ */
+class SpotifyCredentialStore {
+public:
+    virtual ~SpotifyCredentialStore() = default;
+
+    /** @brief Reads the saved credentials.
+     *
+     * @param[out] credentials Filled with what was saved.
+     *
+     * @return True on -- credentials were saved and are intact.
+     */
+    virtual bool load(SpotifyCredentials &credentials) = 0;
+
+    /** @brief Replaces the saved credentials, the old ones must survive a failed save. */
+    virtual bool save(const SpotifyCredentials &credentials) = 0;
+
+    /** @brief Forgets the saved credentials. */
+    virtual void clear() = 0;
+};
+
+/** @brief Keeps the credentials in NVS with Preferences.
+ *
+ * NVS writes the new value before erasing the old, so a power cut during a
+ * save leaves the previous tokens.
+ *
+ * @code{cpp}
+ * SpotifyNvsCredentialStore credentials;
+ * spotify.setCredentialStore(&credentials);
+ * @endcode
+ */
+class SpotifyNvsCredentialStore : public SpotifyCredentialStore {
+public:
+    SpotifyNvsCredentialStore(const char *name = SPOTIFY_CREDENTIAL_NAMESPACE)
+        : _name(name) {}
+
+    bool load(SpotifyCredentials &credentials) override;
+    bool save(const SpotifyCredentials &credentials) override;
+    void clear() override;
+
+private:
+    const char *_name;
+};
+
+/** @brief Keeps the credentials in a file on LittleFS, SPIFFS or an SD card.
+ *
+ * A save is written to a temporary file first, which is only renamed over
+ * the old one once it's complete.
+ *
+ * @code{cpp}
+ * SpotifyFileCredentialStore credentials(LittleFS);
+ *
+ * LittleFS.begin(true);
+ * spotify.setCredentialStore(&credentials);
+ * @endcode
+ */
+class SpotifyFileCredentialStore : public SpotifyCredentialStore {
+public:
+    SpotifyFileCredentialStore(fs::FS &fs, const char *path = SPOTIFY_CREDENTIAL_PATH)
+        : _fs(fs), _path(path) {}
+
+    bool load(SpotifyCredentials &credentials) override;
+    bool save(const SpotifyCredentials &credentials) override;
+    void clear() override;
+
+private:
+    bool read(const String &path, SpotifyCredentials &credentials);
+
+    fs::FS &_fs;
+    const char *_path;
+};
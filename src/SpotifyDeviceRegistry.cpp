@@ -0,0 +1,161 @@
+#include "SpotifyDeviceRegistry.h"
+
+static_assert((SPOTIFY_DEVICE_REGISTRY_BUCKETS & (SPOTIFY_DEVICE_REGISTRY_BUCKETS - 1)) == 0, "SPOTIFY_DEVICE_REGISTRY_BUCKETS must be a power of two");
+static_assert(SPOTIFY_DEVICE_REGISTRY_ENTRIES < 128, "Entries are indexed with int8_t");
+
+SpotifyDeviceRegistry::SpotifyDeviceRegistry()
+    : _entries()
+    , _count(0)
+    , _refreshedMs(0)
+    , _refreshStartedMs(0)
+    , _refreshed(false)
+{
+    memset(_byId, -1, sizeof(_byId));
+    memset(_byName, -1, sizeof(_byName));
+}
+
+const SpotifyDevice* SpotifyDeviceRegistry::findById(const char *id) const
+{
+    int index = lookupById(id);
+    return index >= 0 ? &_entries[index].device : nullptr;
+}
+
+const SpotifyDevice* SpotifyDeviceRegistry::findByName(const char *name) const
+{
+    uint32_t key = hash(name, true);
+
+    int index = _byName[key & (SPOTIFY_DEVICE_REGISTRY_BUCKETS - 1)];
+    while (index >= 0)
+    {
+        const SpotifyDeviceRegistryEntry &entry = _entries[index];
+        if (entry.nameHash == key && strcasecmp(entry.device.name, name) == 0)
+            return &entry.device;
+
+        index = entry.nextByName;
+    }
+
+    return nullptr;
+}
+
+void SpotifyDeviceRegistry::update(const SpotifyDevice &device)
+{
+    if (!device.id[0])
+        return;
+
+    /* Only one device plays at a time. */
+    if (device.isActive)
+        for (int i = 0; i < SPOTIFY_DEVICE_REGISTRY_ENTRIES; i++)
+            _entries[i].device.isActive = false;
+
+    /* The name may have changed, so it's simplest to put the device in again. */
+    int existing = lookupById(device.id);
+    if (existing >= 0)
+        remove(existing);
+
+    if (_count >= SPOTIFY_DEVICE_REGISTRY_ENTRIES)
+    {
+        /* Make room by forgetting the device we heard of the longest ago. */
+        int oldest = -1;
+        for (int i = 0; i < SPOTIFY_DEVICE_REGISTRY_ENTRIES; i++)
+            if (_entries[i].used && (oldest < 0 || (long)(_entries[i].seenMs - _entries[oldest].seenMs) < 0))
+                oldest = i;
+
+        remove(oldest);
+    }
+
+    int index = 0;
+    while (_entries[index].used)
+        index++;
+
+    SpotifyDeviceRegistryEntry &entry = _entries[index];
+    entry.device = device;
+    entry.idHash = hash(device.id, false);
+    entry.nameHash = hash(device.name, true);
+    entry.seenMs = millis();
+    entry.used = true;
+
+    int8_t &idBucket = _byId[entry.idHash & (SPOTIFY_DEVICE_REGISTRY_BUCKETS - 1)];
+    entry.nextById = idBucket;
+    idBucket = index;
+
+    int8_t &nameBucket = _byName[entry.nameHash & (SPOTIFY_DEVICE_REGISTRY_BUCKETS - 1)];
+    entry.nextByName = nameBucket;
+    nameBucket = index;
+
+    _count++;
+}
+
+void SpotifyDeviceRegistry::beginRefresh()
+{
+    _refreshStartedMs = millis();
+}
+
+void SpotifyDeviceRegistry::endRefresh()
+{
+    for (int i = 0; i < SPOTIFY_DEVICE_REGISTRY_ENTRIES; i++)
+        if (_entries[i].used && (long)(_entries[i].seenMs - _refreshStartedMs) < 0)
+            remove(i);
+
+    _refreshedMs = millis();
+    _refreshed = true;
+}
+
+void SpotifyDeviceRegistry::clear()
+{
+    for (int i = 0; i < SPOTIFY_DEVICE_REGISTRY_ENTRIES; i++)
+        _entries[i] = {};
+
+    memset(_byId, -1, sizeof(_byId));
+    memset(_byName, -1, sizeof(_byName));
+
+    _count = 0;
+    _refreshed = false;
+}
+
+bool SpotifyDeviceRegistry::expired() const
+{
+    return !_refreshed || millis() - _refreshedMs > ttlMs;
+}
+
+uint32_t SpotifyDeviceRegistry::hash(const char *text, bool ignoreCase)
+{
+    uint32_t hash = 2166136261u;
+    for (; *text; text++)
+    {
+        hash ^= (uint8_t)(ignoreCase ? tolower(*text) : *text);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+int SpotifyDeviceRegistry::lookupById(const char *id) const
+{
+    uint32_t key = hash(id, false);
+
+    int index = _byId[key & (SPOTIFY_DEVICE_REGISTRY_BUCKETS - 1)];
+    while (index >= 0 && (_entries[index].idHash != key || strcmp(_entries[index].device.id, id) != 0))
+        index = _entries[index].nextById;
+
+    return index;
+}
+
+void SpotifyDeviceRegistry::remove(int index)
+{
+    SpotifyDeviceRegistryEntry &entry = _entries[index];
+
+    unlink(_byId, index, &SpotifyDeviceRegistryEntry::nextById, entry.idHash);
+    unlink(_byName, index, &SpotifyDeviceRegistryEntry::nextByName, entry.nameHash);
+
+    entry = {};
+    _count--;
+}
+
+void SpotifyDeviceRegistry::unlink(int8_t *buckets, int index, int8_t SpotifyDeviceRegistryEntry::*next, uint32_t hash)
+{
+    int8_t *link = &buckets[hash & (SPOTIFY_DEVICE_REGISTRY_BUCKETS - 1)];
+    while (*link != index)
+        link = &(_entries[*link].*next);
+
+    *link = _entries[index].*next;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyConfig.h"
+#include "SpotifyStructs.h"
+
+/** @brief One known device and its places in the lookup tables. */
+struct SpotifyDeviceRegistryEntry {
+    SpotifyDevice device;
+    uint32_t idHash;
+    uint32_t nameHash; /** @brief Of the lowercased name, names match regardless of case. */
+    unsigned long seenMs; /** @brief When Spotify last told us about the device. */
+    int8_t nextById;
+    int8_t nextByName;
+    bool used;
+};
+
+/** @brief Remembers the user's devices so they can be found by name or id without asking Spotify.
+ *
+ * @ref SpotifyESP keeps one of these up to date. The whole list is replaced
+ * when @ref SpotifyESP::getAvailableDevices runs, which happens on its own
+ * once the list is older than @ref ttlMs, and the playing device is updated
+ * from every @ref SpotifyESP::getPlaybackState. Lookups are a hash and a
+ * short bucket walk, names are compared without regard to case.
+ *
+ */
+class SpotifyDeviceRegistry {
+public:
+    SpotifyDeviceRegistry();
+
+    /** @brief Finds a device by its id, nullptr if it isn't known. */
+    const SpotifyDevice* findById(const char *id) const;
+
+    /** @brief Finds a device by its name, nullptr if it isn't known. */
+    const SpotifyDevice* findByName(const char *name) const;
+
+    /** @brief Adds or updates a device, an active device makes the others inactive. */
+    void update(const SpotifyDevice &device);
+
+    /** @brief Starts replacing the list, devices not updated before @ref endRefresh are forgotten. */
+    void beginRefresh();
+
+    /** @brief Forgets devices that weren't in the new list and restarts the TTL. */
+    void endRefresh();
+
+    /** @brief Forgets every device. */
+    void clear();
+
+    /** @brief Whether the list is older than @ref ttlMs, or was never fetched. */
+    bool expired() const;
+
+    /** @brief How many devices are known. */
+    int count() const { return _count; }
+
+    /** @brief FNV-1a of a string, lowercased for names. */
+    static uint32_t hash(const char *text, bool ignoreCase);
+
+    unsigned long ttlMs = SPOTIFY_DEVICE_REGISTRY_TTL;
+
+private:
+    int lookupById(const char *id) const;
+    void remove(int index);
+    void unlink(int8_t *buckets, int index, int8_t SpotifyDeviceRegistryEntry::*next, uint32_t hash);
+
+    SpotifyDeviceRegistryEntry _entries[SPOTIFY_DEVICE_REGISTRY_ENTRIES];
+    int8_t _byId[SPOTIFY_DEVICE_REGISTRY_BUCKETS];
+    int8_t _byName[SPOTIFY_DEVICE_REGISTRY_BUCKETS];
+    int _count;
+    unsigned long _refreshedMs;
+    unsigned long _refreshStartedMs;
+    bool _refreshed;
+};
@@ -0,0 +1,184 @@
+#include <new>
+
+#include <WiFi.h>
+
+#include "SpotifyDnsCache.h"
+
+/* Handed to the refresh task, which owns and deletes it. */
+struct SpotifyDnsRefresh {
+    SpotifyDnsCache *cache;
+    char host[SPOTIFY_HOST_CHAR_LENGTH];
+};
+
+SpotifyDnsCache::SpotifyDnsCache()
+    : _entries()
+    , _hits(0)
+    , _staleHits(0)
+    , _misses(0)
+{
+    _mutex = xSemaphoreCreateMutexStatic(&_mutexBuffer);
+}
+
+bool SpotifyDnsCache::resolve(const char *host, IPAddress &address)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    unsigned long now = millis();
+    SpotifyDnsEntry *entry = find(host);
+
+    if (entry && now - entry->resolvedMs < ttlMs)
+    {
+        _hits++;
+        entry->lastUsedMs = now;
+        address = entry->address;
+        xSemaphoreGive(_mutex);
+        return true;
+    }
+
+    if (entry && now - entry->resolvedMs < staleTtlMs)
+    {
+        _staleHits++;
+        entry->lastUsedMs = now;
+        address = entry->address;
+
+        /* Serve the old address, refresh it in the background. */
+        if (!entry->refreshing)
+        {
+            SpotifyDnsRefresh *refresh = new (std::nothrow) SpotifyDnsRefresh();
+            if (refresh)
+            {
+                refresh->cache = this;
+                strncpy(refresh->host, host, sizeof(refresh->host)-1);
+                refresh->host[sizeof(refresh->host)-1] = '\0';
+
+                entry->refreshing = xTaskCreate(refreshTask, "spotifyDns", 3072, refresh, 1, NULL) == pdPASS;
+                if (!entry->refreshing)
+                    delete refresh;
+            }
+        }
+
+        xSemaphoreGive(_mutex);
+        return true;
+    }
+
+    _misses++;
+    xSemaphoreGive(_mutex);
+
+    /* Nothing usable, the request has to wait for the resolver. */
+    IPAddress resolved;
+    if (!WiFi.hostByName(host, resolved))
+    {
+        log_e("Could not resolve %s", host);
+        return false;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    entry = find(host);
+    if (!entry)
+    {
+        entry = findSlot();
+        strncpy(entry->host, host, sizeof(entry->host)-1);
+        entry->host[sizeof(entry->host)-1] = '\0';
+        entry->refreshing = false;
+    }
+
+    entry->address = resolved;
+    entry->resolvedMs = millis();
+    entry->lastUsedMs = entry->resolvedMs;
+
+    xSemaphoreGive(_mutex);
+
+    address = resolved;
+    return true;
+}
+
+void SpotifyDnsCache::invalidate(const char *host)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    SpotifyDnsEntry *entry = find(host);
+    if (entry)
+    {
+        /* A refresh task still writes to this entry, age it out instead of freeing it. */
+        if (entry->refreshing)
+            entry->resolvedMs = millis() - staleTtlMs;
+        else
+            entry->host[0] = '\0';
+    }
+
+    xSemaphoreGive(_mutex);
+}
+
+void SpotifyDnsCache::clear()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    /* Entries being refreshed are left for their task to fill in. */
+    for (int i = 0; i < SPOTIFY_DNS_CACHE_ENTRIES; i++)
+        if (!_entries[i].refreshing)
+            _entries[i].host[0] = '\0';
+
+    xSemaphoreGive(_mutex);
+}
+
+void SpotifyDnsCache::refreshTask(void *parameter)
+{
+    SpotifyDnsRefresh *refresh = static_cast<SpotifyDnsRefresh*>(parameter);
+    SpotifyDnsCache *cache = refresh->cache;
+
+    IPAddress resolved;
+    bool found = WiFi.hostByName(refresh->host, resolved);
+
+    xSemaphoreTake(cache->_mutex, portMAX_DELAY);
+
+    SpotifyDnsEntry *entry = cache->find(refresh->host);
+    if (entry)
+    {
+        if (found)
+        {
+            entry->address = resolved;
+            entry->resolvedMs = millis();
+        }
+
+        entry->refreshing = false;
+    }
+
+    xSemaphoreGive(cache->_mutex);
+
+    log_d("Refreshed %s: %s", refresh->host, found ? resolved.toString().c_str() : "failed");
+
+    delete refresh;
+    vTaskDelete(NULL);
+}
+
+SpotifyDnsEntry* SpotifyDnsCache::find(const char *host)
+{
+    for (int i = 0; i < SPOTIFY_DNS_CACHE_ENTRIES; i++)
+        if (_entries[i].host[0] != '\0' && strcmp(_entries[i].host, host) == 0)
+            return &_entries[i];
+
+    return nullptr;
+}
+
+SpotifyDnsEntry* SpotifyDnsCache::findSlot()
+{
+    SpotifyDnsEntry *oldest = nullptr;
+    unsigned long now = millis();
+
+    for (int i = 0; i < SPOTIFY_DNS_CACHE_ENTRIES; i++)
+    {
+        SpotifyDnsEntry *entry = &_entries[i];
+        if (entry->host[0] == '\0')
+            return entry;
+
+        /* Never evict an entry a refresh task is about to write to. */
+        if (entry->refreshing)
+            continue;
+
+        if (!oldest || (now - entry->lastUsedMs) > (now - oldest->lastUsedMs))
+            oldest = entry;
+    }
+
+    return oldest ? oldest : &_entries[0];
+}
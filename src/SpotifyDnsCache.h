@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "SpotifyConfig.h"
+
+/** @brief A resolved address for one of the hosts we talk to. */
+struct SpotifyDnsEntry {
+    char host[SPOTIFY_HOST_CHAR_LENGTH];
+    IPAddress address;
+    unsigned long resolvedMs; /** @brief When the address was last looked up. */
+    unsigned long lastUsedMs;
+    bool refreshing; /** @brief A background lookup is running for this host. */
+};
+
+/** @brief Caches DNS lookups of the Spotify hosts.
+ *
+ * Some home routers are slow or flaky at answering DNS, and every request
+ * would otherwise look its host up again. Addresses are kept for @ref ttlMs,
+ * after that the old address is still handed out while a background task
+ * looks the host up again, so a request never waits on a refresh. Only when
+ * an address is older than @ref staleTtlMs does a lookup block again.
+ *
+ * The Arduino resolver doesn't tell us the TTL of the record itself, so the
+ * TTL is configured here instead.
+ *
+ */
+class SpotifyDnsCache {
+public:
+    SpotifyDnsCache();
+
+    SpotifyDnsCache(const SpotifyDnsCache&) = delete;
+    SpotifyDnsCache& operator=(const SpotifyDnsCache&) = delete;
+
+    /** @brief Resolves a host, from the cache if possible.
+     *
+     * @param[in] host The host name to look up.
+     * @param[out] address The address of the host.
+     *
+     * @return True on -- an address was found, cached or not.
+     */
+    bool resolve(const char *host, IPAddress &address);
+
+    /** @brief Forgets the cached address of one host.
+     *
+     * The next lookup of the host waits on the resolver again, use when the
+     * cached address stopped answering.
+     *
+     * @param[in] host The host name to forget.
+     */
+    void invalidate(const char *host);
+
+    /** @brief Forgets every cached address, use after switching networks. */
+    void clear();
+
+    uint32_t hits() const { return _hits; } /** @brief Lookups answered with a fresh address. */
+    uint32_t staleHits() const { return _staleHits; } /** @brief Lookups answered with an expired address while it refreshes. */
+    uint32_t misses() const { return _misses; } /** @brief Lookups that had to wait on the resolver. */
+
+    unsigned long ttlMs = SPOTIFY_DNS_TTL;
+    unsigned long staleTtlMs = SPOTIFY_DNS_STALE_TTL;
+
+private:
+    static void refreshTask(void *parameter);
+
+    SpotifyDnsEntry* find(const char *host);
+    SpotifyDnsEntry* findSlot();
+
+    SpotifyDnsEntry _entries[SPOTIFY_DNS_CACHE_ENTRIES];
+    uint32_t _hits;
+    uint32_t _staleHits;
+    uint32_t _misses;
+    SemaphoreHandle_t _mutex;
+    StaticSemaphore_t _mutexBuffer;
+};
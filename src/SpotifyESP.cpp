@@ -1,4 +1,8 @@
+#include <new>
+
 #include <mbedtls/sha256.h>
+#include <esp_heap_caps.h>
+#include <time.h>
 
 #include "SpotifyESP.h"
 
@@ -8,21 +12,69 @@ SpotifyESP::SpotifyESP()
     , _refreshToken()
     , _clientId(nullptr)
     , _clientSecret(nullptr)
+    , _grantedScopes((SpotifyScopeFlags)SpotifyScopeFlagBits::eAll)
+    , _product(SpotifyProduct::eUnknown)
+    , _imageConnection(nullptr)
+    , _imageCache(nullptr)
+    , _imageMemoryCache(nullptr)
+    , _imageMemory(nullptr)
+    , _imageMemoryCopy(nullptr)
+    , _compressionStats()
+    , _imageTransfer()
+    , _prefetch()
+    , _prefetchCount(0)
+    , _imageHost()
+    , _imagePath()
+    , _queue()
+    , _queueCount(0)
+    , _queueCurrent(0)
+    , _searchCache(nullptr)
+    , _credentialStore(nullptr)
 {
 }
 
 SpotifyESP::SpotifyESP(WiFiClientSecure &wifiClient, HTTPClient &httpClient, SpotifyCodeFlow flow)
 {   
     _flow = flow;
-    this->_wifiClient = &wifiClient;
-    this->_httpClient = &httpClient;
+    _imageConnection = nullptr;
+    _imageCache = nullptr;
+    _imageMemoryCache = nullptr;
+    _imageMemory = nullptr;
+    _imageMemoryCopy = nullptr;
+    _compressionStats = {};
+    _imageTransfer = {};
+    _prefetchCount = 0;
+    _imageHost[0] = '\0';
+    _imagePath[0] = '\0';
+    _queueCount = 0;
+    _queueCurrent = 0;
+    _searchCache = nullptr;
+    _grantedScopes = (SpotifyScopeFlags)SpotifyScopeFlagBits::eAll;
+    _product = SpotifyProduct::eUnknown;
+    _credentialStore = nullptr;
+    _connections.add(wifiClient, httpClient);
 }
 
 SpotifyESP::SpotifyESP(WiFiClientSecure &wifiClient, HTTPClient &httpClient, const char *clientId, const char *refreshToken)
 {
     _flow = SpotifyCodeFlow::eAuthorizationCodeWithPKCE;
-    this->_wifiClient = &wifiClient;
-    this->_httpClient = &httpClient;
+    _imageConnection = nullptr;
+    _imageCache = nullptr;
+    _imageMemoryCache = nullptr;
+    _imageMemory = nullptr;
+    _imageMemoryCopy = nullptr;
+    _compressionStats = {};
+    _imageTransfer = {};
+    _prefetchCount = 0;
+    _imageHost[0] = '\0';
+    _imagePath[0] = '\0';
+    _queueCount = 0;
+    _queueCurrent = 0;
+    _searchCache = nullptr;
+    _grantedScopes = (SpotifyScopeFlags)SpotifyScopeFlagBits::eAll;
+    _product = SpotifyProduct::eUnknown;
+    _credentialStore = nullptr;
+    _connections.add(wifiClient, httpClient);
     this->_clientId = clientId;
     setRefreshToken(refreshToken);
 }
@@ -30,8 +82,23 @@ SpotifyESP::SpotifyESP(WiFiClientSecure &wifiClient, HTTPClient &httpClient, con
 SpotifyESP::SpotifyESP(WiFiClientSecure &wifiClient, HTTPClient &httpClient, const char *clientId, const char *clientSecret, const char *refreshToken)
 {
     _flow = SpotifyCodeFlow::eAuthorizationCode;
-    this->_wifiClient = &wifiClient;
-    this->_httpClient = &httpClient;
+    _imageConnection = nullptr;
+    _imageCache = nullptr;
+    _imageMemoryCache = nullptr;
+    _imageMemory = nullptr;
+    _imageMemoryCopy = nullptr;
+    _compressionStats = {};
+    _imageTransfer = {};
+    _prefetchCount = 0;
+    _imageHost[0] = '\0';
+    _imagePath[0] = '\0';
+    _queueCount = 0;
+    _queueCurrent = 0;
+    _searchCache = nullptr;
+    _grantedScopes = (SpotifyScopeFlags)SpotifyScopeFlagBits::eAll;
+    _product = SpotifyProduct::eUnknown;
+    _credentialStore = nullptr;
+    _connections.add(wifiClient, httpClient);
     this->_clientId = clientId;
     this->_clientSecret = clientSecret;
     setRefreshToken(refreshToken);
@@ -42,6 +109,49 @@ void SpotifyESP::setClientId(const char* clientId)
     _clientId = clientId;
 }
 
+bool SpotifyESP::addConnection(WiFiClientSecure &wifiClient, HTTPClient &httpClient)
+{
+    return _connections.add(wifiClient, httpClient);
+}
+
+SpotifyConnectionPool& SpotifyESP::getConnectionPool()
+{
+    return _connections;
+}
+
+bool SpotifyESP::warmConnection(unsigned long idleTimeoutMs)
+{
+    /* A token refresh would cost another round trip right when the user is waiting. */
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    return _connections.warm(SPOTIFY_HOST, idleTimeoutMs);
+}
+
+void SpotifyESP::maintainConnections()
+{
+    _connections.closeExpired();
+}
+
+SpotifyCompressionStats SpotifyESP::getCompressionStats()
+{
+    portENTER_CRITICAL(&_statsLock);
+    SpotifyCompressionStats stats = _compressionStats;
+    portEXIT_CRITICAL(&_statsLock);
+
+    return stats;
+}
+
+void SpotifyESP::addCompressionStats(const SpotifyInflateStream &inflated)
+{
+    /* Pages are read on a prefetch task while the caller may be reading another response. */
+    portENTER_CRITICAL(&_statsLock);
+    _compressionStats.responses++;
+    _compressionStats.compressedBytes += inflated.compressedBytes();
+    _compressionStats.decompressedBytes += inflated.decompressedBytes();
+    portEXIT_CRITICAL(&_statsLock);
+}
+
 void SpotifyESP::generateCodeChallengeForPKCE(char* buffer)
 {
     /* Reset any previous values. */
@@ -73,6 +183,37 @@ void SpotifyESP::generateCodeChallengeForPKCE(char* buffer)
     // log_i("Verifier Challenge Encoded: %s", buffer); /* We don't know how long the user's string actually is. */
 }
 
+/* Names of the scopes as Spotify spells them, for the authorize URL and the token response. */
+static const struct {
+    SpotifyScopeFlagBits bit;
+    const char *name;
+} scopeNames[] = {
+    { SpotifyScopeFlagBits::eUgcImageUpload, "ugc-image-upload" },
+    { SpotifyScopeFlagBits::eUserReadPlaybackState, "user-read-playback-state" },
+    { SpotifyScopeFlagBits::eUserModifyPlaybackState, "user-modify-playback-state" },
+    { SpotifyScopeFlagBits::eUserReadCurrentlyPlaying, "user-read-currently-playing" },
+    { SpotifyScopeFlagBits::eAppRemoteControl, "app-remote-control" },
+    { SpotifyScopeFlagBits::eStreaming, "streaming" },
+    { SpotifyScopeFlagBits::ePlaylistReadPrivate, "playlist-read-private" },
+    { SpotifyScopeFlagBits::ePlaylistReadCollaborative, "playlist-read-collaborative" },
+    { SpotifyScopeFlagBits::ePlaylistModifyPrivate, "playlist-modify-private" },
+    { SpotifyScopeFlagBits::ePlaylistModifyPublic, "playlist-modify-public" },
+    { SpotifyScopeFlagBits::eUserFollowModify, "user-follow-modify" },
+    { SpotifyScopeFlagBits::eUserFollowRead, "user-follow-read" },
+    { SpotifyScopeFlagBits::eUserReadPlaybackPosition, "user-read-playback-position" },
+    { SpotifyScopeFlagBits::eUserTopRead, "user-top-read" },
+    { SpotifyScopeFlagBits::eUserReadRecentlyPlayed, "user-read-recently-played" },
+    { SpotifyScopeFlagBits::eUserLibraryModify, "user-library-modify" },
+    { SpotifyScopeFlagBits::eUserLibraryRead, "user-library-read" },
+    { SpotifyScopeFlagBits::eUserReadEmail, "user-read-email" },
+    { SpotifyScopeFlagBits::eUserReadPrivate, "user-read-private" },
+    { SpotifyScopeFlagBits::eUserSoaLink, "user-soa-link" },
+    { SpotifyScopeFlagBits::eUserSoaUnlink, "user-soa-unlink" },
+    { SpotifyScopeFlagBits::eUserManageEntitlements, "user-manage-entitlements" },
+    { SpotifyScopeFlagBits::eUserManagePartner, "user-manage-partner" },
+    { SpotifyScopeFlagBits::eUserCreatePartner, "user-create-partner" },
+};
+
 int SpotifyESP::generateRedirectForPKCE(SpotifyScopeFlags scopes, const char *redirect, char *buffer, size_t bufferLength)
 {
     int written = 0;
@@ -98,38 +239,16 @@ int SpotifyESP::generateRedirectForPKCE(SpotifyScopeFlags scopes, const char *re
         return false;
 
     /* Append the scope flags onto the end of the buffer. */
-    auto appendScope = [&scopes, &buffer, &bufferLength, &written](SpotifyScopeFlagBits bit, const char* str){ 
-        if (scopes & bit) 
-            written = strlcat(buffer, str, bufferLength);
-    };
-
     if (scopes != SpotifyScopeFlagBits::eNone) 
     {
-        /* TODO: convert these strings to be in program memory. */
-        appendScope(SpotifyScopeFlagBits::eUgcImageUpload, "ugc-image-upload+");
-        appendScope(SpotifyScopeFlagBits::eUserReadPlaybackState, "user-read-playback-state+");
-        appendScope(SpotifyScopeFlagBits::eUserModifyPlaybackState, "user-modify-playback-state+");
-        appendScope(SpotifyScopeFlagBits::eUserReadCurrentlyPlaying, "user-read-currently-playing+");
-        appendScope(SpotifyScopeFlagBits::eAppRemoteControl, "app-remote-control+");
-        appendScope(SpotifyScopeFlagBits::eStreaming, "streaming+");
-        appendScope(SpotifyScopeFlagBits::ePlaylistReadPrivate, "playlist-read-private+");
-        appendScope(SpotifyScopeFlagBits::ePlaylistReadCollaborative, "playlist-read-collaborative+");
-        appendScope(SpotifyScopeFlagBits::ePlaylistModifyPrivate, "playlist-modify-private+");
-        appendScope(SpotifyScopeFlagBits::ePlaylistModifyPublic, "playlist-modify-public+");
-        appendScope(SpotifyScopeFlagBits::eUserFollowModify, "user-follow-modify+");
-        appendScope(SpotifyScopeFlagBits::eUserFollowRead, "user-follow-read+");
-        appendScope(SpotifyScopeFlagBits::eUserReadPlaybackPosition, "user-read-playback-position+");
-        appendScope(SpotifyScopeFlagBits::eUserTopRead, "user-top-read+");
-        appendScope(SpotifyScopeFlagBits::eUserReadRecentlyPlayed, "user-read-recently-played+");
-        appendScope(SpotifyScopeFlagBits::eUserLibraryModify, "user-library-modify+");
-        appendScope(SpotifyScopeFlagBits::eUserLibraryRead, "user-library-read+");
-        appendScope(SpotifyScopeFlagBits::eUserReadEmail, "user-read-email+");
-        appendScope(SpotifyScopeFlagBits::eUserReadPrivate, "user-read-private+");
-        appendScope(SpotifyScopeFlagBits::eUserSoaLink, "user-soa-link+");
-        appendScope(SpotifyScopeFlagBits::eUserSoaUnlink, "user-soa-unlink+");
-        appendScope(SpotifyScopeFlagBits::eUserManageEntitlements, "user-manage-entitlements+");
-        appendScope(SpotifyScopeFlagBits::eUserManagePartner, "user-manage-partner+");
-        appendScope(SpotifyScopeFlagBits::eUserCreatePartner, "user-create-partner+");
+        for (const auto &scope : scopeNames)
+        {
+            if (scopes & scope.bit)
+            {
+                strlcat(buffer, scope.name, bufferLength);
+                written = strlcat(buffer, "+", bufferLength);
+            }
+        }
 
         /* Remove the last '+' from the scopes. */
         char* lastPlus = strrchr(buffer, '+');
@@ -168,15 +287,35 @@ int SpotifyESP::generateRedirectForPKCE(
     return written;
 }
 
-int SpotifyESP::makeRequestWithBody(const char *type, const char *command, const char *authorization, const char *body, const char *contentType, const char *host)
+/* Responses without a body leave nothing on the socket. */
+static void checkEmptyBody(SpotifyConnection *connection, int statusCode)
+{
+    if (statusCode == 204 || statusCode == 304 || connection->httpClient->getSize() == 0)
+        connection->bodyRead = true;
+}
+
+bool SpotifyESP::beginRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *contentType, const char *host, bool &reused)
 {
+    /* Get a connection for the host, there may not be enough heap for one. */
+    connection = _connections.acquire(host);
+    if (!connection)
+        return false;
+
+    HTTPClient *httpClient = connection->httpClient;
+
+    /* Open the session ourselves so the host is resolved through the DNS cache. */
+    reused = connection->wifiClient->connected();
+    connection->bodyRead = false;
+    if (!_connections.connect(connection))
+        return false;
+
     /* Setup the HTTP client for the request. */
-    _httpClient->setUserAgent("TALOS/1.0");
-    _httpClient->setTimeout(SPOTIFY_TIMEOUT);
-    _httpClient->setConnectTimeout(SPOTIFY_TIMEOUT);
-    _httpClient->setReuse(false);
-    _httpClient->useHTTP10(true);
-    _httpClient->begin(*_wifiClient, host, 443, command);
+    httpClient->setUserAgent("TALOS/1.0");
+    httpClient->setTimeout(SPOTIFY_TIMEOUT);
+    httpClient->setConnectTimeout(SPOTIFY_TIMEOUT);
+    httpClient->useHTTP10(true); /* Also turns reuse off, so it has to come first. */
+    httpClient->setReuse(connection->keepAlive);
+    httpClient->begin(*connection->wifiClient, host, 443, command);
     
     log_d("%s", command);
 
@@ -184,45 +323,225 @@ int SpotifyESP::makeRequestWithBody(const char *type, const char *command, const
     yield(); 
 
     /* Add the requests header values. */
-    _httpClient->addHeader("Content-Type", contentType);
+    httpClient->addHeader("Content-Type", contentType);
+
+    if (authorization != NULL) httpClient->addHeader("Authorization", authorization);
+    /* httpClient->addHeader("Cache-Control", "no-cache"); */
+
+    return true;
+}
+
+int SpotifyESP::makeRequestWithBody(SpotifyConnection *&connection, const char *type, const char *command, const char *authorization, const char *body, const char *contentType, const char *host)
+{
+    bool reused;
+    if (!beginRequest(connection, command, authorization, contentType, host, reused))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
 
-    if (authorization != NULL) _httpClient->addHeader("Authorization", authorization);
-    /* _httpClient->addHeader("Cache-Control", "no-cache"); */
+    HTTPClient *httpClient = connection->httpClient;
 
     /* Make the HTTP request. */
-    return _httpClient->sendRequest(type, body);
+    int statusCode = httpClient->sendRequest(type, body);
+
+    /* The server may have dropped a kept alive socket, try once more on a fresh one. */
+    if (statusCode < 0 && reused)
+    {
+        log_d("Kept alive connection was closed, retrying");
+        connection->wifiClient->stop();
+        _connections.connect(connection);
+        statusCode = httpClient->sendRequest(type, body);
+    }
+
+    checkEmptyBody(connection, statusCode);
+    return statusCode;
+}
+
+int SpotifyESP::makeRequestWithBody(SpotifyConnection *&connection, const char *type, const char *command, const char *authorization, const SpotifyRequestBody &body, const char *host)
+{
+    bool reused;
+    if (!beginRequest(connection, command, authorization, "application/json", host, reused))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    HTTPClient *httpClient = connection->httpClient;
+
+    /* The body is written out as the client reads it, it's never whole in memory. */
+    SpotifyBodyStream stream(body);
+    int statusCode = httpClient->sendRequest(type, &stream, stream.size());
+
+    if (statusCode < 0 && reused)
+    {
+        log_d("Kept alive connection was closed, retrying");
+        connection->wifiClient->stop();
+        _connections.connect(connection);
+        stream.rewind();
+        statusCode = httpClient->sendRequest(type, &stream, stream.size());
+    }
+
+    checkEmptyBody(connection, statusCode);
+    return statusCode;
 }
 
-int SpotifyESP::makePutRequest(const char *command, const char *authorization, const char *body, const char *contentType, const char *host)
+int SpotifyESP::makePutRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *body, const char *contentType, const char *host)
 {
-    return makeRequestWithBody("PUT", command, authorization, body, contentType);
+    return makeRequestWithBody(connection, "PUT", command, authorization, body, contentType, host);
 }
 
-int SpotifyESP::makePostRequest(const char *command, const char *authorization, const char *body, const char *contentType, const char *host)
+int SpotifyESP::makePostRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *body, const char *contentType, const char *host)
 {
-    return makeRequestWithBody("POST", command, authorization, body, contentType, host);
+    return makeRequestWithBody(connection, "POST", command, authorization, body, contentType, host);
 }
 
-int SpotifyESP::makeGetRequest(const char *command, const char *authorization, const char *accept, const char *host)
+int SpotifyESP::makeGetRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *accept, const char *host, bool compressed, const char *range)
 {
-    _httpClient->setUserAgent("TALOS/1.0");
-    _httpClient->setTimeout(SPOTIFY_TIMEOUT);
-    _httpClient->setConnectTimeout(SPOTIFY_TIMEOUT);
-    _httpClient->setReuse(false);
-    _httpClient->useHTTP10(true);
-    _httpClient->begin(*_wifiClient, host, 443, command);
+    connection = _connections.acquire(host);
+    if (!connection)
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    HTTPClient *httpClient = connection->httpClient;
+
+    /* Open the session ourselves so the host is resolved through the DNS cache. */
+    bool reused = connection->wifiClient->connected();
+    connection->bodyRead = false;
+    if (!_connections.connect(connection))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    httpClient->setUserAgent("TALOS/1.0");
+    httpClient->setTimeout(SPOTIFY_TIMEOUT);
+    httpClient->setConnectTimeout(SPOTIFY_TIMEOUT);
+    httpClient->useHTTP10(true); /* Also turns reuse off, so it has to come first. */
+    httpClient->setReuse(connection->keepAlive);
+    httpClient->begin(*connection->wifiClient, host, 443, command);
     
     log_i("%s", command);
 
     // give the esp a breather
     yield();
 
-    if (accept) _httpClient->addHeader("Accept", accept);
-    if (authorization)  _httpClient->addHeader("Authorization", authorization);
+    if (accept) httpClient->addHeader("Accept", accept);
+    if (authorization)  httpClient->addHeader("Authorization", authorization);
 
-    _httpClient->addHeader("Cache-Control", "no-cache");
+    httpClient->addHeader("Cache-Control", "no-cache");
+
+    /* We need to see how the body was encoded to know if it has to be inflated, and which part of it a range is. */
+    const char *collect[] = { "Content-Encoding", "Content-Range" };
+    httpClient->collectHeaders(collect, 2);
+
+    if (compressed && SpotifyInflateStream::canAllocate())
+        httpClient->addHeader("Accept-Encoding", "gzip, deflate");
+
+    if (range)
+        httpClient->addHeader("Range", range);
     
-    return _httpClient->GET();
+    int statusCode = httpClient->GET();
+
+    /* The server may have dropped a kept alive socket, try once more on a fresh one. */
+    if (statusCode < 0 && reused)
+    {
+        log_d("Kept alive connection was closed, retrying");
+        connection->wifiClient->stop();
+        _connections.connect(connection);
+        statusCode = httpClient->GET();
+    }
+
+    checkEmptyBody(connection, statusCode);
+    return statusCode;
+}
+
+DeserializationError SpotifyESP::deserializeResponse(JsonDocument &doc, SpotifyConnection *connection, const JsonDocument *filter)
+{
+    SpotifyBufferedStream stream(connection->httpClient->getStream(), jsonStreamBlockSize);
+
+    String contentEncoding = connection->httpClient->header("Content-Encoding");
+    if (contentEncoding.isEmpty() || contentEncoding.equalsIgnoreCase("identity"))
+    {
+        DeserializationError error = filter 
+            ? deserializeJson(doc, stream, DeserializationOption::Filter(*filter))
+            : deserializeJson(doc, stream);
+
+        if (!error)
+            drainResponse(connection, stream.received());
+
+        return error;
+    }
+
+    SpotifyInflateStream inflated(stream, contentEncoding.equalsIgnoreCase("gzip") 
+        ? SpotifyContentEncoding::eGzip 
+        : SpotifyContentEncoding::eDeflate);
+
+    if (!inflated.valid())
+        return DeserializationError::InvalidInput;
+
+    DeserializationError error = filter 
+        ? deserializeJson(doc, inflated, DeserializationOption::Filter(*filter))
+        : deserializeJson(doc, inflated);
+
+    addCompressionStats(inflated);
+
+    log_d("Inflated %d bytes into %d", inflated.compressedBytes(), inflated.decompressedBytes());
+
+    if (!error)
+        drainResponse(connection, stream.received());
+
+    return error;
+}
+
+bool SpotifyESP::wantsCompression(SpotifyEndpointFlagBits endpoint)
+{
+#ifdef SPOTIFY_PRINT_JSON_PARSE
+    return false; /* The payload is printed as it was received, it has to be readable. */
+#else
+    return (compressedEndpoints & endpoint) != 0;
+#endif
+}
+
+void SpotifyESP::drainResponse(SpotifyConnection *connection, size_t received)
+{
+    if (!connection || !connection->keepAlive || connection->bodyRead)
+        return;
+
+    /* Without a length there's no telling where the body ends. */
+    int size = connection->httpClient->getSize();
+    if (size < 0)
+        return;
+
+    size_t remaining = received < (size_t)size ? size - received : 0;
+    if (remaining > SPOTIFY_DRAIN_LIMIT)
+        return;
+
+    WiFiClientSecure &client = *connection->wifiClient;
+    uint8_t scratch[64];
+    unsigned long lastData = millis();
+
+    while (remaining > 0)
+    {
+        int c = client.available() > 0 ? client.read(scratch, min(remaining, sizeof(scratch))) : 0;
+        if (c > 0)
+        {
+            remaining -= c;
+            lastData = millis();
+            continue;
+        }
+
+        if (!client.connected() || millis() - lastData >= SPOTIFY_TIMEOUT)
+            return;
+
+        delay(1);
+    }
+
+    connection->bodyRead = true;
+}
+
+void SpotifyESP::endRequest(SpotifyConnection *&connection)
+{
+    if (!connection)
+        return;
+
+    /* Leftover bytes would be read as the start of the next response. */
+    if (connection->keepAlive && !connection->bodyRead)
+        connection->wifiClient->stop();
+
+    connection->httpClient->end();
+    _connections.release(connection);
+    connection = nullptr;
 }
 
 void SpotifyESP::setRefreshToken(const char *refreshToken)
@@ -239,11 +558,12 @@ bool SpotifyESP::refreshAccessToken()
 {
     char body[500];
 
-    StaticJsonDocument<64> filter;
+    StaticJsonDocument<96> filter;
     filter["token_type"] = true;
     filter["expires_in"] = true;
     filter["access_token"] = true;
     filter["refresh_token"] = true;
+    filter["scope"] = true;
 
     /* Build the body of the request. */
     switch (_flow) {
@@ -257,7 +577,8 @@ bool SpotifyESP::refreshAccessToken()
 
     log_i("%s", body);
 
-    int statusCode = makePostRequest(SPOTIFY_TOKEN_ENDPOINT, NULL, body, "application/x-www-form-urlencoded", SPOTIFY_ACCOUNTS_HOST);
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makePostRequest(connection, SPOTIFY_TOKEN_ENDPOINT, NULL, body, "application/x-www-form-urlencoded", SPOTIFY_ACCOUNTS_HOST);
 
     unsigned long now = millis();
         
@@ -267,16 +588,17 @@ bool SpotifyESP::refreshAccessToken()
 
     if (statusCode != 200)
     {
-        processAuthenticationError();
+        if (statusCode > 0)
+            processAuthenticationError(connection);
         goto done;
     }
 
     // Parse JSON object
     {
     #ifndef SPOTIFY_PRINT_JSON_PARSE
-        DeserializationError error = deserializeJson(doc, _httpClient->getStream(), DeserializationOption::Filter(filter));
+        DeserializationError error = deserializeResponse(doc, connection, &filter);
     #else
-        String data = _httpClient->getString();
+        String data = connection->httpClient->getString();
         log_d("payload: %s", data.c_str());
         DeserializationError error = deserializeJson(doc, data, DeserializationOption::Filter(filter));
     #endif
@@ -289,7 +611,10 @@ bool SpotifyESP::refreshAccessToken()
 
     log_d("No JSON error, dealing with response");
 
-    _refreshToken = doc["refresh_token"].as<const char*>();
+    /* Spotify doesn't always rotate the refresh token, the old one stays good when it's left out. */
+    if (doc.containsKey("refresh_token"))
+        _refreshToken = doc["refresh_token"].as<const char*>();
+
     if (_refreshToken.isEmpty())
     {
         log_e("Problem with refresh token!");
@@ -304,6 +629,11 @@ bool SpotifyESP::refreshAccessToken()
         tokenTimeToLiveMs = (tokenTtl * 1000) - 2000; // The 2000 is just to force the token expiry to check if its very close
         timeTokenRefreshed = now;
         refreshed = true;
+
+        if (doc.containsKey("scope"))
+            _grantedScopes = parseScopes(doc["scope"]);
+
+        saveCredentials(tokenTtl);
     }
     else
     {
@@ -314,7 +644,7 @@ bool SpotifyESP::refreshAccessToken()
     log_i("Recieved new refresh token: %s", _refreshToken.c_str());
 
 done:
-    _httpClient->end();
+    endRequest(connection);
     return refreshed;
 }
 
@@ -344,15 +674,17 @@ SpotifyResult SpotifyESP::requestAccessTokens(const char *code, const char *redi
 
     log_d("%s", body);
 
-    int statusCode = makePostRequest(SPOTIFY_TOKEN_ENDPOINT, NULL, body, "application/x-www-form-urlencoded", SPOTIFY_ACCOUNTS_HOST);
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makePostRequest(connection, SPOTIFY_TOKEN_ENDPOINT, NULL, body, "application/x-www-form-urlencoded", SPOTIFY_ACCOUNTS_HOST);
     
     unsigned long now = millis();
 
     log_d("Status code: %d", statusCode);
 
     if (statusCode != 200) {
-        _httpClient->end();
-        return processAuthenticationError();
+        SpotifyResult result = (statusCode > 0) ? processAuthenticationError(connection) : SpotifyResult::eRequestFailed;
+        endRequest(connection);
+        return result;
     }
 
     /* Parse the JSON body received from Spotify.*/
@@ -360,18 +692,19 @@ SpotifyResult SpotifyESP::requestAccessTokens(const char *code, const char *redi
     filter["access_token"] = true;
     filter["refresh_token"] = true;
     filter["expires_in"] = true;
+    filter["scope"] = true;
 
     DynamicJsonDocument doc(1000);
 
 #ifndef SPOTIFY_PRINT_JSON_PARSE
-    DeserializationError error = deserializeJson(doc, _httpClient->getStream(), DeserializationOption::Filter(filter));
+    DeserializationError error = deserializeResponse(doc, connection, &filter);
 #else
-    String payload = _httpClient->getString();
+    String payload = connection->httpClient->getString();
     log_i("Received from Spotify: %s", payload.c_str());
     DeserializationError error = deserializeJson(doc, payload, DeserializationOption::Filter(filter));
 #endif
 
-    _httpClient->end();
+    endRequest(connection);
 
     /* Check if there was a problem deserializing the body JSON. */
     if (error)
@@ -383,6 +716,166 @@ SpotifyResult SpotifyESP::requestAccessTokens(const char *code, const char *redi
     tokenTimeToLiveMs = (tokenTtl * 1000) - 2000; // The 2000 is just to force the token expiry to check if its very close
     timeTokenRefreshed = now;
 
+    if (doc.containsKey("scope"))
+        _grantedScopes = parseScopes(doc["scope"]);
+
+    /* It may be a different user now. */
+    _product = SpotifyProduct::eUnknown;
+
+    saveCredentials(tokenTtl);
+
+    return SpotifyResult::eSuccess;
+}
+
+SpotifyScopeFlags SpotifyESP::getGrantedScopes()
+{
+    return _grantedScopes;
+}
+
+bool SpotifyESP::setCredentialStore(SpotifyCredentialStore *credentialStore)
+{
+    _credentialStore = credentialStore;
+
+    SpotifyCredentials credentials;
+    if (!_credentialStore || !_credentialStore->load(credentials))
+        return false;
+
+    if (credentials.refreshToken[0])
+        _refreshToken = credentials.refreshToken;
+
+    /* Without a set clock there's no telling how much of the access token is left. */
+    time_t now = time(nullptr);
+    if (now < SPOTIFY_CLOCK_VALID_AFTER || !credentials.accessToken[0])
+        return true;
+
+    int64_t remaining = credentials.expiresAt - (int64_t)now;
+    if (remaining * 1000 <= 2000)
+        return true;
+
+    snprintf(_bearerToken, sizeof(_bearerToken), "Bearer %s", credentials.accessToken);
+    tokenTimeToLiveMs = (remaining * 1000) - 2000; // Same margin as a fresh token
+    timeTokenRefreshed = millis();
+    _grantedScopes = credentials.scopes;
+
+    log_i("Restored an access token with %lld seconds left", remaining);
+    return true;
+}
+
+void SpotifyESP::saveCredentials(int tokenTtl)
+{
+    if (!_credentialStore)
+        return;
+
+    /* A cut off refresh token would replace a good one on the next boot. */
+    if (_refreshToken.length() > SPOTIFY_REFRESH_TOKEN_LENGTH)
+    {
+        log_e("The refresh token is longer than SPOTIFY_REFRESH_TOKEN_LENGTH, not saving it");
+        return;
+    }
+
+    SpotifyCredentials credentials = {};
+
+    /* The bearer token is kept with its "Bearer " prefix. */
+    const char *space = strchr(_bearerToken, ' ');
+    strncpy(credentials.accessToken, space ? space + 1 : _bearerToken, sizeof(credentials.accessToken)-1);
+    strncpy(credentials.refreshToken, _refreshToken.c_str(), sizeof(credentials.refreshToken)-1);
+
+    time_t now = time(nullptr);
+    credentials.expiresAt = now >= SPOTIFY_CLOCK_VALID_AFTER ? (int64_t)now + tokenTtl : 0;
+    credentials.scopes = _grantedScopes;
+
+    if (!_credentialStore->save(credentials))
+        log_e("Could not save the new tokens");
+}
+
+SpotifyScopeFlags SpotifyESP::parseScopes(const char *scopes)
+{
+    SpotifyScopeFlags flags = 0;
+    if (!scopes)
+        return flags;
+
+    /* Spotify separates the granted scopes with spaces. */
+    while (*scopes)
+    {
+        const char *end = strchr(scopes, ' ');
+        size_t length = end ? end - scopes : strlen(scopes);
+
+        for (const auto &scope : scopeNames)
+            if (strlen(scope.name) == length && strncmp(scope.name, scopes, length) == 0)
+                flags = flags | scope.bit;
+
+        scopes += length;
+        while (*scopes == ' ')
+            scopes++;
+    }
+
+    return flags;
+}
+
+SpotifyResult SpotifyESP::checkAccess(SpotifyScopeFlags anyOf, bool premium)
+{
+    if (!gateRequests)
+        return SpotifyResult::eSuccess;
+
+    if (anyOf && !(_grantedScopes & anyOf))
+    {
+        log_e("The access token wasn't granted a scope this request needs, not sending it");
+        return SpotifyResult::eMissingScope;
+    }
+
+    if (premium && _product == SpotifyProduct::eFree)
+    {
+        log_e("This request needs Spotify Premium, not sending it");
+        return SpotifyResult::ePremiumRequired;
+    }
+
+    return SpotifyResult::eSuccess;
+}
+
+SpotifyResult SpotifyESP::getProduct(SpotifyProduct &product, bool refresh)
+{
+    if (_product != SpotifyProduct::eUnknown && !refresh)
+    {
+        product = _product;
+        return SpotifyResult::eSuccess;
+    }
+
+    log_d(SPOTIFY_USER_PROFILE_ENDPOINT);
+
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, SPOTIFY_USER_PROFILE_ENDPOINT, _bearerToken);
+
+    if (statusCode != 200)
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
+
+    StaticJsonDocument<32> filter;
+    filter["product"] = true;
+
+    StaticJsonDocument<64> doc;
+    DeserializationError error = deserializeResponse(doc, connection, &filter);
+
+    endRequest(connection);
+
+    if (error)
+        return processJsonError(error);
+
+    /* Only sent when the token has user-read-private. */
+    const char *name = doc["product"];
+    if (!name)
+        _product = SpotifyProduct::eUnknown;
+    else if (strcmp(name, "premium") == 0)
+        _product = SpotifyProduct::ePremium;
+    else
+        _product = SpotifyProduct::eFree;
+
+    product = _product;
     return SpotifyResult::eSuccess;
 }
 
@@ -398,6 +891,11 @@ SpotifyResult SpotifyESP::playAdvanced(char *body, const char *deviceId)
     return playerControl(command, deviceId, body);
 }
 
+SpotifyResult SpotifyESP::play(const SpotifyPlayRequest &request, const char *deviceId)
+{
+    return sendPlayerBody("PUT", SPOTIFY_PLAY_ENDPOINT, deviceId, request);
+}
+
 SpotifyResult SpotifyESP::pause(const char *deviceId)
 {
     char command[100] = SPOTIFY_PAUSE_ENDPOINT;
@@ -445,6 +943,13 @@ SpotifyResult SpotifyESP::setRepeatMode(SpotifyRepeatMode repeat, const char *de
 
 SpotifyResult SpotifyESP::playerControl(char *command, const char *deviceId, const char *body)
 {
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserModifyPlaybackState, true);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    deviceId = resolveDeviceId(deviceId);
+    if (!deviceId)
+        return SpotifyResult::eDeviceNotFound;
     if (deviceId[0] != 0)
     {
         char *questionMarkPointer;
@@ -465,16 +970,26 @@ SpotifyResult SpotifyESP::playerControl(char *command, const char *deviceId, con
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makePutRequest(command, _bearerToken, body);
-    _httpClient->end();
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makePutRequest(connection, command, _bearerToken, body);
 
-    return statusCode == 204 /* Will return 204 if all went well. */
+    SpotifyResult result = statusCode == 204 /* Will return 204 if all went well. */
             ? SpotifyResult::eSuccess 
-            : processRegularError(statusCode); 
+            : processRegularError(statusCode, connection); 
+
+    endRequest(connection);
+    return result;
 }
 
 SpotifyResult SpotifyESP::playerNavigate(char *command, const char *deviceId)
 {
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserModifyPlaybackState, true);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    deviceId = resolveDeviceId(deviceId);
+    if (!deviceId)
+        return SpotifyResult::eDeviceNotFound;
     if (deviceId[0] != 0)
     {
         char deviceIdBuff[50];
@@ -487,12 +1002,15 @@ SpotifyResult SpotifyESP::playerNavigate(char *command, const char *deviceId)
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makePostRequest(command, _bearerToken);
-    _httpClient->end();
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makePostRequest(connection, command, _bearerToken);
 
-    return statusCode == 204 /* Will return 204 if all went well. */
+    SpotifyResult result = statusCode == 204 /* Will return 204 if all went well. */
             ? SpotifyResult::eSuccess 
-            : processRegularError(statusCode); 
+            : processRegularError(statusCode, connection); 
+
+    endRequest(connection);
+    return result;
 }
 
 SpotifyResult SpotifyESP::skipToNext(const char *deviceId)
@@ -509,13 +1027,21 @@ SpotifyResult SpotifyESP::skipToPrevious(const char *deviceId)
 
 SpotifyResult SpotifyESP::seekToPosition(int position, const char *deviceId)
 {
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserModifyPlaybackState, true);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
     char command[100] = SPOTIFY_SEEK_ENDPOINT;
     char tempBuff[100];
     sprintf(tempBuff, "?position_ms=%d", position);
     strcat(command, tempBuff);
+
+    deviceId = resolveDeviceId(deviceId);
+    if (!deviceId)
+        return SpotifyResult::eDeviceNotFound;
     if (deviceId[0] != 0)
     {
-        sprintf(tempBuff, "?device_id=%s", deviceId);
+        sprintf(tempBuff, "&device_id=%s", deviceId);
         strcat(command, tempBuff);
     }
 
@@ -524,36 +1050,128 @@ SpotifyResult SpotifyESP::seekToPosition(int position, const char *deviceId)
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makePutRequest(command, _bearerToken);
-    _httpClient->end();
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makePutRequest(connection, command, _bearerToken);
 
-    return statusCode == 204 /* Will return 204 if all went well. */
+    SpotifyResult result = statusCode == 204 /* Will return 204 if all went well. */
             ? SpotifyResult::eSuccess 
-            : processRegularError(statusCode); 
+            : processRegularError(statusCode, connection); 
+
+    endRequest(connection);
+    return result;
 }
 
 SpotifyResult SpotifyESP::transferPlayback(const char *deviceId, bool play)
 {
-    char body[100];
-    sprintf(body, "{\"device_ids\":[\"%s\"],\"play\":\"%s\"}", deviceId, (play ? "true" : "false"));
+    deviceId = resolveDeviceId(deviceId);
+    if (!deviceId)
+        return SpotifyResult::eDeviceNotFound;
 
-    log_d("%s", SPOTIFY_PLAYER_ENDPOINT);
-    log_d("%s", body);
+    return sendPlayerBody("PUT", SPOTIFY_PLAYER_ENDPOINT, "", SpotifyTransferRequest(deviceId, play));
+}
+
+SpotifyResult SpotifyESP::findDevice(const char *nameOrId, SpotifyDevice *device)
+{
+    const SpotifyDevice *found = lookupDevice(nameOrId);
+    if (!found)
+        return SpotifyResult::eDeviceNotFound;
+
+    if (device)
+        *device = *found;
+
+    return SpotifyResult::eSuccess;
+}
+
+/* Device ids are 40 hex digits, a name that happens to look like one is unlikely. */
+static bool isDeviceId(const char *deviceId)
+{
+    for (int i = 0; i < 40; i++)
+        if (!isxdigit((unsigned char)deviceId[i]))
+            return false;
+
+    return deviceId[40] == '\0';
+}
+
+const SpotifyDevice* SpotifyESP::lookupDevice(const char *nameOrId)
+{
+    if (!nameOrId || !nameOrId[0])
+        return nullptr;
+
+    const SpotifyDevice *device = _devices.findById(nameOrId);
+    if (!device && !isDeviceId(nameOrId))
+        device = _devices.findByName(nameOrId);
+
+    /* A miss on a fresh list means there's no such device, only a stale one is worth fetching again. */
+    if (device || !_devices.expired())
+        return device;
+
+    log_d("%s isn't a known device, fetching the device list", nameOrId);
+
+    if (getAvailableDevices([](SpotifyDevice, int, int) { return true; }) != SpotifyResult::eSuccess)
+        return nullptr;
+
+    device = _devices.findById(nameOrId);
+    return device ? device : _devices.findByName(nameOrId);
+}
+
+const char* SpotifyESP::resolveDeviceId(const char *deviceId)
+{
+    if (!deviceId || !deviceId[0])
+        return "";
+
+    /* Spotify takes an id as it is, only a name needs the device list. */
+    if (isDeviceId(deviceId))
+        return deviceId;
+
+    /* Anything else is a name, sending one on as an id would only make Spotify fail the request. */
+    const SpotifyDevice *device = lookupDevice(deviceId);
+    return device ? device->id : nullptr;
+}
+
+SpotifyResult SpotifyESP::sendPlayerBody(const char *type, const char *endpoint, const char *deviceId, const SpotifyRequestBody &body)
+{
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserModifyPlaybackState, true);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    if (!body.valid())
+    {
+        log_e("Request body for %s doesn't make sense, not sending it", endpoint);
+        return SpotifyResult::eInvalidRequest;
+    }
+
+    deviceId = resolveDeviceId(deviceId);
+    if (!deviceId)
+        return SpotifyResult::eDeviceNotFound;
+
+    char command[SPOTIFY_URL_CHAR_LENGTH + SPOTIFY_DEVICE_ID_CHAR_LENGTH];
+    if (deviceId[0])
+        snprintf(command, sizeof(command), "%s%cdevice_id=%s", endpoint, strchr(endpoint, '?') ? '&' : '?', deviceId);
+    else
+        snprintf(command, sizeof(command), "%s", endpoint);
+
+    log_d("%s", command);
 
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makePutRequest(SPOTIFY_PLAYER_ENDPOINT, _bearerToken, body);
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeRequestWithBody(connection, type, command, _bearerToken, body);
 
-    _httpClient->end();
-    
-    return statusCode == 204 /* Will return 204 if all went well. */
+    SpotifyResult result = statusCode == 204 /* Will return 204 if all went well. */
             ? SpotifyResult::eSuccess 
-            : processRegularError(statusCode); 
+            : processRegularError(statusCode, connection); 
+
+    endRequest(connection);
+    return result;
 }
 
 SpotifyResult SpotifyESP::getCurrentlyPlayingTrack(SpotifyCallbackOnCurrentlyPlaying currentlyPlayingCallback, const char *market)
 {
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserReadCurrentlyPlaying | SpotifyScopeFlagBits::eUserReadPlaybackState);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
     char command[120] = SPOTIFY_CURRENTLY_PLAYING_ENDPOINT;
     if (market[0] != 0)
     {
@@ -570,11 +1188,16 @@ SpotifyResult SpotifyESP::getCurrentlyPlayingTrack(SpotifyCallbackOnCurrentlyPla
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makeGetRequest(command, _bearerToken);
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, command, _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eCurrentlyPlaying));
     log_d("%d", statusCode);
 
     if (statusCode != 200)
-        return processRegularError(statusCode);
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
 
     SpotifyCurrentlyPlaying current;
 
@@ -618,14 +1241,14 @@ SpotifyResult SpotifyESP::getCurrentlyPlayingTrack(SpotifyCallbackOnCurrentlyPla
 
     // Parse JSON object
 #ifndef SPOTIFY_PRINT_JSON_PARSE
-    DeserializationError error = deserializeJson(doc, _httpClient->getStream(), DeserializationOption::Filter(filter));
+    DeserializationError error = deserializeResponse(doc, connection, &filter);
 #else
-    String payload = _httpClient->getString();
+    String payload = connection->httpClient->getString();
     log_i("Received from Spotify: %s", payload.c_str());
     DeserializationError error = deserializeJson(doc, payload, DeserializationOption::Filter(filter));
 #endif
     
-    _httpClient->end();
+    endRequest(connection);
 
     if (error)
         return processJsonError(error);
@@ -762,6 +1385,10 @@ SpotifyResult SpotifyESP::getCurrentlyPlayingTrack(SpotifyCallbackOnCurrentlyPla
 
 SpotifyResult SpotifyESP::getPlaybackState(SpotifyCallbackOnPlaybackState playerDetailsCallback, const char *market)
 {
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserReadPlaybackState);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
     char command[100] = SPOTIFY_PLAYER_ENDPOINT;
     if (market[0] != 0)
     {
@@ -777,11 +1404,16 @@ SpotifyResult SpotifyESP::getPlaybackState(SpotifyCallbackOnPlaybackState player
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makeGetRequest(command, _bearerToken);
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, command, _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::ePlaybackState));
     log_d("Status Code: %s", statusCode);
 
-    if (statusCode != 200) 
-        return processRegularError(statusCode);
+    if (statusCode != 200)
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
 
     StaticJsonDocument<192> filter;
     JsonObject filter_device = filter.createNestedObject("device");
@@ -802,14 +1434,14 @@ SpotifyResult SpotifyESP::getPlaybackState(SpotifyCallbackOnPlaybackState player
 
     // Parse JSON object
 #ifndef SPOTIFY_PRINT_JSON_PARSE
-    DeserializationError error = deserializeJson(doc, _httpClient->getStream(), DeserializationOption::Filter(filter));
+    DeserializationError error = deserializeResponse(doc, connection, &filter);
 #else
-    String payload = _httpClient->getString();
+    String payload = connection->httpClient->getString();
     log_i("Received from Spotify: %s", payload.c_str());
     DeserializationError error = deserializeJson(doc, payload, DeserializationOption::Filter(filter));
 #endif
     
-    _httpClient->end();
+    endRequest(connection);
 
     if (error)
         return processJsonError(error);
@@ -826,6 +1458,7 @@ SpotifyResult SpotifyESP::getPlaybackState(SpotifyCallbackOnPlaybackState player
     playerDetails.device.isPrivateSession = device["is_private_session"].as<bool>();
     playerDetails.device.isRestricted = device["is_restricted"].as<bool>();
     playerDetails.device.volumePercent = device["volume_percent"].as<int>();
+    _devices.update(playerDetails.device);
 
     playerDetails.progressMs = doc["progress_ms"].as<long>();
     playerDetails.isPlaying = doc["is_playing"].as<bool>();
@@ -854,6 +1487,10 @@ SpotifyResult SpotifyESP::getPlaybackState(SpotifyCallbackOnPlaybackState player
 
 SpotifyResult SpotifyESP::getAvailableDevices(SpotifyCallbackOnDevices devicesCallback)
 {
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserReadPlaybackState);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
     log_i(SPOTIFY_DEVICES_ENDPOINT);
 
     // Get from https://arduinojson.org/v6/assistant/
@@ -861,33 +1498,41 @@ SpotifyResult SpotifyESP::getAvailableDevices(SpotifyCallbackOnDevices devicesCa
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makeGetRequest(SPOTIFY_DEVICES_ENDPOINT, _bearerToken);
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, SPOTIFY_DEVICES_ENDPOINT, _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eDevices));
     log_d("Status Code: %s", statusCode);
 
     if (statusCode != 200)
-        return processRegularError(statusCode);
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
 
     // Allocate DynamicJsonDocument
     DynamicJsonDocument doc(bufferSize);
 
     // Parse JSON object
 #ifndef SPOTIFY_PRINT_JSON_PARSE
-    DeserializationError error = deserializeJson(doc, _httpClient->getStream());
+    DeserializationError error = deserializeResponse(doc, connection);
 #else
-    ReadLoggingStream loggingStream(_httpClient->getStream(), Serial);
+    ReadLoggingStream loggingStream(connection->httpClient->getStream(), Serial);
     DeserializationError error = deserializeJson(doc, loggingStream);
 #endif
 
-    _httpClient->end();
+    endRequest(connection);
 
     if (error)
         return processJsonError(error);
 
     uint8_t totalDevices = doc["devices"].size();
 
-    SpotifyDevice spotifyDevice;
+    _devices.beginRefresh();
+
+    bool stopped = false;
     for (int i = 0; i < totalDevices; i++)
     {
+        SpotifyDevice spotifyDevice = {};
         JsonObject device = doc["devices"][i];
         strncpy(spotifyDevice.id, device["id"].as<const char *>(), sizeof(spotifyDevice.id)-1);
         strncpy(spotifyDevice.name, device["name"].as<const char *>(), sizeof(spotifyDevice.name)-1);
@@ -898,30 +1543,44 @@ SpotifyResult SpotifyESP::getAvailableDevices(SpotifyCallbackOnDevices devicesCa
         spotifyDevice.isRestricted = device["is_restricted"].as<bool>();
         spotifyDevice.volumePercent = device["volume_percent"].as<int>();
 
-        if (!devicesCallback(spotifyDevice, i, totalDevices))
+        /* The registry wants every device even when the user has stopped. */
+        _devices.update(spotifyDevice);
+
+        if (!stopped && !devicesCallback(spotifyDevice, i, totalDevices))
         {
             //User has indicated they are finished.
-            break;
+            stopped = true;
         }
     }
 
+    _devices.endRefresh();
+
     return SpotifyResult::eSuccess;
 }
 
-SpotifyResult SpotifyESP::searchForSong(String query, int limit, SpotifyCallbackOnSearch searchCallback, SpotifySearchResult results[])
+SpotifyResult SpotifyESP::searchForSong(const String &query, int limit, SpotifyCallbackOnSearch searchCallback, SpotifySearchResult results[])
 {
     log_i(SPOTIFY_SEARCH_ENDPOINT);
 
+    char command[SPOTIFY_SEARCH_PATH_LENGTH];
+    if (snprintf(command, sizeof(command), SPOTIFY_SEARCH_ENDPOINT "%s&limit=%d", query.c_str(), limit) >= (int)sizeof(command))
+        return SpotifyResult::eQueryTooLong;
+
     // Get from https://arduinojson.org/v6/assistant/
     const size_t bufferSize = searchDetailsBufferSize;
     if (autoTokenRefresh)
         checkAndRefreshAccessToken();
 
-    int statusCode = makeGetRequest((SPOTIFY_SEARCH_ENDPOINT + query + "&limit=" + limit).c_str(), _bearerToken);
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, command, _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eSearch));
     log_d("Status Code: %d", statusCode);
 
     if (statusCode != 200)
-        return processRegularError(statusCode);
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
 
 
     // Allocate DynamicJsonDocument
@@ -929,14 +1588,14 @@ SpotifyResult SpotifyESP::searchForSong(String query, int limit, SpotifyCallback
 
     // Parse JSON object
 #ifndef SPOTIFY_PRINT_JSON_PARSE
-    DeserializationError error = deserializeJson(doc, _httpClient->getStream());
+    DeserializationError error = deserializeResponse(doc, connection);
 #else
-    String payload = _httpClient->getString();
+    String payload = connection->httpClient->getString();
     log_i("Received from Spotify: %s", payload.c_str());
     DeserializationError error = deserializeJson(doc, payload);
 #endif
 
-    _httpClient->end();
+    endRequest(connection);
 
     if (error)
         return processJsonError(error);
@@ -948,38 +1607,7 @@ SpotifyResult SpotifyESP::searchForSong(String query, int limit, SpotifyCallback
     SpotifySearchResult searchResult;
     for (int i = 0; i < totalResults; i++)
     {
-        //Polling track information
-        JsonObject result = doc["tracks"]["items"][i];
-        strncpy(searchResult.trackUri, result["uri"].as<const char *>(), sizeof(searchResult.trackUri)-1);
-        strncpy(searchResult.trackName, result["name"].as<const char *>(), sizeof(searchResult.trackName)-1);
-        strncpy(searchResult.albumUri, result["album"]["uri"].as<const char *>(), sizeof(searchResult.albumUri)-1);
-        strncpy(searchResult.albumName, result["album"]["name"].as<const char *>(), sizeof(searchResult.albumName)-1);
-
-        //Pull artist Information for the result
-        uint8_t totalArtists = result["artists"].size();
-        searchResult.numArtists = totalArtists;
-
-        SpotifyArtist artist;
-        for (int j = 0; j < totalArtists; j++)
-        {
-            JsonObject artistResult = result["artists"][j];
-            strncpy(artist.artistName, artistResult["name"].as<const char *>(), sizeof(artist.artistName)-1);
-            strncpy(artist.artistUri, artistResult["uri"].as<const char *>(), sizeof(artist.artistUri)-1);
-            searchResult.artists[j] = artist;
-        }
-
-        uint8_t totalImages = result["album"]["images"].size();
-        searchResult.numImages = totalImages;
-
-        SpotifyImage image;
-        for (int j = 0; j < totalImages; j++)
-        {
-            JsonObject imageResult = result["album"]["images"][j];
-            image.height = imageResult["height"].as<int>();
-            image.width = imageResult["width"].as<int>();
-            strncpy(image.url, imageResult["url"].as<const char *>(), sizeof(image.url)-1);
-            searchResult.albumImages[j] = image;
-        }
+        parseTrack(doc["tracks"]["items"][i], searchResult);
 
         //log_i(searchResult.trackName);
         if (results)
@@ -995,10 +1623,1250 @@ SpotifyResult SpotifyESP::searchForSong(String query, int limit, SpotifyCallback
     return SpotifyResult::eSuccess;
 }
 
-SpotifyResult SpotifyESP::requestImage(char* imageUrl, size_t* length)
+/* The types a search can ask for and their key in the response. */
+static const struct {
+    SpotifySearchTypeFlagBits type;
+    const char *key;
+} searchTypes[] = {
+    { SpotifySearchTypeFlagBits::eTrack, "tracks" },
+    { SpotifySearchTypeFlagBits::eAlbum, "albums" },
+    { SpotifySearchTypeFlagBits::eArtist, "artists" },
+    { SpotifySearchTypeFlagBits::ePlaylist, "playlists" },
+};
+
+SpotifyResult SpotifyESP::search(const char *query, const SpotifySearchCallbacks &callbacks, int limit)
 {
-    log_d("Parsing image URL: %s", imageUrl);
-    uint8_t lengthOfString = strlen(imageUrl);
+    SpotifySearchQuery searchQuery;
+    searchQuery.text(query);
+    return search(searchQuery, callbacks, limit);
+}
+
+SpotifyResult SpotifyESP::search(SpotifySearchQuery &query, const SpotifySearchCallbacks &callbacks, int limit)
+{
+    if (!query.ok())
+        return SpotifyResult::eQueryTooLong;
+
+    SpotifySearchTypeFlags types = 0;
+    if (callbacks.onTrack)
+        types = types | SpotifySearchTypeFlagBits::eTrack;
+    if (callbacks.onAlbum)
+        types = types | SpotifySearchTypeFlagBits::eAlbum;
+    if (callbacks.onArtist)
+        types = types | SpotifySearchTypeFlagBits::eArtist;
+    if (callbacks.onPlaylist)
+        types = types | SpotifySearchTypeFlagBits::ePlaylist;
+
+    if (!types)
+        return SpotifyResult::eSuccess;
+
+    limit = constrain(limit, 1, SPOTIFY_MAX_SEARCH_RESULTS);
+
+    if (_searchCache)
+    {
+        size_t length;
+        const uint8_t *cached = _searchCache->find(query.terms(), types, limit, &length);
+        if (cached)
+        {
+            log_d("Search for %s served from the cache", query.terms());
+            return replaySearch(cached, length, callbacks);
+        }
+    }
+
+    const char *command = query.path(types, limit);
+    if (!command)
+        return SpotifyResult::eQueryTooLong;
+
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, command, _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eSearch));
+    log_d("Status Code: %d", statusCode);
+
+    if (statusCode != 200)
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
+
+    /* Each item is also packed as it goes by, for the cache. Too many results and it just isn't cached. */
+    uint8_t *record = nullptr;
+    size_t recorded = 0;
+    if (_searchCache)
+    {
+        record = (uint8_t*)heap_caps_malloc(SPOTIFY_SEARCH_RECORD_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!record)
+            record = (uint8_t*)malloc(SPOTIFY_SEARCH_RECORD_SIZE);
+    }
+
+    StaticJsonDocument<384> filter;
+    int indices[sizeof(searchTypes) / sizeof(searchTypes[0])] = {};
+    bool stopped = false;
+
+    SpotifyResult result = readResponse(connection, [&](Stream &source) {
+        if (readJsonToken(source) != '{')
+            return SpotifyResult::eJsonInvalidInput;
+
+        /* The types come back as paging objects in whatever order Spotify likes. */
+        while (true)
+        {
+            int c = readJsonToken(source);
+            if (c == ',')
+                continue;
+            if (c == '}')
+                return SpotifyResult::eSuccess;
+            if (c != '"')
+                return c < 0 ? SpotifyResult::eJsonIncompleteInput : SpotifyResult::eJsonInvalidInput;
+
+            char name[16];
+            size_t length = source.readBytesUntil('"', name, sizeof(name)-1);
+            name[length] = '\0';
+
+            if (readJsonToken(source) != ':' || readJsonToken(source) != '{')
+                return SpotifyResult::eJsonInvalidInput;
+
+            int typeIndex = -1;
+            for (int i = 0; i < (int)(sizeof(searchTypes) / sizeof(searchTypes[0])); i++)
+                if (strcmp(name, searchTypes[i].key) == 0 && (types & searchTypes[i].type))
+                    typeIndex = i;
+
+            if (typeIndex < 0)
+            {
+                if (!skipJsonObject(source))
+                    return SpotifyResult::eJsonIncompleteInput;
+                continue;
+            }
+
+            SpotifySearchTypeFlagBits type = searchTypes[typeIndex].type;
+            JsonObject itemFilter = filter.to<JsonObject>();
+
+            switch (type)
+            {
+                case SpotifySearchTypeFlagBits::eTrack: trackFilter(itemFilter); break;
+                case SpotifySearchTypeFlagBits::eAlbum: albumFilter(itemFilter); break;
+                case SpotifySearchTypeFlagBits::ePlaylist: playlistFilter(itemFilter); break;
+                default:
+                    itemFilter["name"] = true;
+                    itemFilter["uri"] = true;
+                    break;
+            }
+
+            SpotifyResult read = readJsonArray(source, "items", filter, [&](JsonVariantConst item) {
+                /* Playlists that were taken down come back as null. */
+                if (item.isNull())
+                    return true;
+
+                if (record)
+                {
+                    size_t packed = measureMsgPack(item);
+                    if (recorded + 3 + packed <= SPOTIFY_SEARCH_RECORD_SIZE)
+                    {
+                        record[recorded] = (uint8_t)type;
+                        record[recorded + 1] = packed & 0xff;
+                        record[recorded + 2] = packed >> 8;
+                        serializeMsgPack(item, record + recorded + 3, packed);
+                        recorded += 3 + packed;
+                    }
+                    else
+                    {
+                        free(record);
+                        record = nullptr;
+                    }
+                }
+
+                stopped = !deliverSearchItem(type, item, indices[typeIndex]++, callbacks);
+                return !stopped;
+            });
+
+            if (read != SpotifyResult::eSuccess || stopped)
+                return read;
+
+            if (!skipJsonObject(source))
+                return SpotifyResult::eJsonIncompleteInput;
+        }
+    });
+
+    endRequest(connection);
+
+    if (record)
+    {
+        if (result == SpotifyResult::eSuccess && !stopped)
+            _searchCache->insert(query.terms(), types, limit, record, recorded);
+
+        free(record);
+    }
+
+    return result;
+}
+
+SpotifyResult SpotifyESP::replaySearch(const uint8_t *records, size_t length, const SpotifySearchCallbacks &callbacks)
+{
+    DynamicJsonDocument doc(catalogItemBufferSize);
+    int indices[sizeof(searchTypes) / sizeof(searchTypes[0])] = {};
+
+    /* Each record is the type, a 16 bit length and the item as MessagePack. */
+    size_t offset = 0;
+    while (offset + 3 <= length)
+    {
+        SpotifySearchTypeFlagBits type = (SpotifySearchTypeFlagBits)records[offset];
+        size_t packed = records[offset + 1] | (records[offset + 2] << 8);
+
+        DeserializationError error = deserializeMsgPack(doc, (const char*)records + offset + 3, packed);
+        if (error)
+            return processJsonError(error);
+
+        offset += 3 + packed;
+
+        int typeIndex = __builtin_ctz((uint32_t)type);
+        if (!deliverSearchItem(type, doc.as<JsonVariantConst>(), indices[typeIndex]++, callbacks))
+            break;
+    }
+
+    return SpotifyResult::eSuccess;
+}
+
+bool SpotifyESP::deliverSearchItem(SpotifySearchTypeFlagBits type, JsonVariantConst item, int index, const SpotifySearchCallbacks &callbacks)
+{
+    switch (type)
+    {
+        case SpotifySearchTypeFlagBits::eTrack:
+        {
+            SpotifyTrack track;
+            parseTrack(item, track);
+            return callbacks.onTrack(track, index, -1);
+        }
+        case SpotifySearchTypeFlagBits::eAlbum:
+        {
+            SpotifyAlbum album;
+            parseAlbum(item, album);
+            return callbacks.onAlbum(album, index, -1);
+        }
+        case SpotifySearchTypeFlagBits::eArtist:
+        {
+            SpotifyArtist artist = {};
+            strncpy(artist.artistName, item["name"] | "", sizeof(artist.artistName)-1);
+            strncpy(artist.artistUri, item["uri"] | "", sizeof(artist.artistUri)-1);
+            return callbacks.onArtist(artist, index, -1);
+        }
+        case SpotifySearchTypeFlagBits::ePlaylist:
+        {
+            SpotifyPlaylist playlist;
+            parsePlaylist(item, playlist);
+            return callbacks.onPlaylist(playlist, index, -1);
+        }
+        default:
+            return true;
+    }
+}
+
+void SpotifyESP::setSearchCache(SpotifySearchCache *searchCache)
+{
+    _searchCache = searchCache;
+}
+
+SpotifyResult SpotifyESP::getTracks(const char *const *uris, int count, SpotifyCallbackOnTrack callback, const char *market)
+{
+    StaticJsonDocument<384> filter;
+    trackFilter(filter.to<JsonObject>());
+
+    return getSeveral(SPOTIFY_TRACKS_ENDPOINT, "tracks", uris, count, SPOTIFY_MAX_TRACKS_PER_REQUEST, market, filter,
+        [&](JsonVariantConst item, int index) {
+            SpotifyTrack track;
+            parseTrack(item, track);
+            return callback(track, index, count);
+        });
+}
+
+SpotifyResult SpotifyESP::getAlbums(const char *const *uris, int count, SpotifyCallbackOnAlbum callback, const char *market)
+{
+    StaticJsonDocument<384> filter;
+    albumFilter(filter.to<JsonObject>());
+
+    return getSeveral(SPOTIFY_ALBUMS_ENDPOINT, "albums", uris, count, SPOTIFY_MAX_ALBUMS_PER_REQUEST, market, filter,
+        [&](JsonVariantConst item, int index) {
+            SpotifyAlbum album;
+            parseAlbum(item, album);
+            return callback(album, index, count);
+        });
+}
+
+SpotifyResult SpotifyESP::getArtists(const char *const *uris, int count, SpotifyCallbackOnArtist callback)
+{
+    StaticJsonDocument<64> filter;
+    filter["name"] = true;
+    filter["uri"] = true;
+
+    return getSeveral(SPOTIFY_ARTISTS_ENDPOINT, "artists", uris, count, SPOTIFY_MAX_ARTISTS_PER_REQUEST, "", filter,
+        [&](JsonVariantConst item, int index) {
+            SpotifyArtist artist = {};
+            strncpy(artist.artistName, item["name"] | "", sizeof(artist.artistName)-1);
+            strncpy(artist.artistUri, item["uri"] | "", sizeof(artist.artistUri)-1);
+            return callback(artist, index, count);
+        });
+}
+
+SpotifyResult SpotifyESP::getPlaylistTracks(const char *playlist, SpotifyCallbackOnTrack callback, const char *market)
+{
+    /* Only ask for what parseTrack reads, playlist pages are large otherwise. */
+    String endpoint = String("/v1/playlists/") + idFromUri(playlist) + "/tracks?fields=total,items(track(name,uri,album(name,uri,images),artists(name,uri)))&";
+    if (market && market[0])
+        endpoint = endpoint + "market=" + market + "&";
+
+    StaticJsonDocument<384> filter;
+    trackFilter(filter.createNestedObject("track"));
+
+    return getPaged(endpoint, sizeof(SpotifyTrack), SPOTIFY_MAX_PLAYLIST_ITEMS_PER_PAGE, filter,
+        [](JsonVariantConst element, void *item) {
+            /* Removed and local tracks come back as null. */
+            if (element["track"].isNull())
+                return false;
+
+            parseTrack(element["track"], *(SpotifyTrack*)item);
+            return true;
+        },
+        [&](const void *item, int index, int total) {
+            return callback(*(const SpotifyTrack*)item, index, total);
+        });
+}
+
+SpotifyResult SpotifyESP::getPlaylistSnapshotId(const char *playlist, char *snapshotId, size_t length)
+{
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    /* Just the one field, so checking for changes costs next to nothing. */
+    String command = String("/v1/playlists/") + idFromUri(playlist) + "?fields=snapshot_id";
+
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, command.c_str(), _bearerToken);
+    log_d("Status Code: %d", statusCode);
+
+    if (statusCode != 200)
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
+
+    StaticJsonDocument<256> doc;
+    DeserializationError error = deserializeResponse(doc, connection);
+    endRequest(connection);
+
+    if (error)
+        return processJsonError(error);
+
+    strncpy(snapshotId, doc["snapshot_id"] | "", length-1);
+    snapshotId[length-1] = '\0';
+
+    return SpotifyResult::eSuccess;
+}
+
+SpotifyResult SpotifyESP::getSavedTracks(SpotifyCallbackOnTrack callback, const char *market)
+{
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserLibraryRead);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    String endpoint = SPOTIFY_SAVED_TRACKS_ENDPOINT;
+    if (market && market[0])
+        endpoint = endpoint + "market=" + market + "&";
+
+    StaticJsonDocument<384> filter;
+    trackFilter(filter.createNestedObject("track"));
+
+    return getPaged(endpoint, sizeof(SpotifyTrack), SPOTIFY_MAX_LIBRARY_ITEMS_PER_PAGE, filter,
+        [](JsonVariantConst element, void *item) {
+            if (element["track"].isNull())
+                return false;
+
+            parseTrack(element["track"], *(SpotifyTrack*)item);
+            return true;
+        },
+        [&](const void *item, int index, int total) {
+            return callback(*(const SpotifyTrack*)item, index, total);
+        });
+}
+
+SpotifyResult SpotifyESP::getUserPlaylists(SpotifyCallbackOnPlaylist callback)
+{
+    StaticJsonDocument<384> filter;
+    playlistFilter(filter.to<JsonObject>());
+
+    return getPaged(SPOTIFY_USER_PLAYLISTS_ENDPOINT, sizeof(SpotifyPlaylist), SPOTIFY_MAX_LIBRARY_ITEMS_PER_PAGE, filter,
+        [](JsonVariantConst element, void *item) {
+            parsePlaylist(element, *(SpotifyPlaylist*)item);
+            return true;
+        },
+        [&](const void *item, int index, int total) {
+            return callback(*(const SpotifyPlaylist*)item, index, total);
+        });
+}
+
+/* PSRAM if there is some, otherwise only if it leaves room for a TLS session. */
+static uint8_t* allocatePage(size_t size)
+{
+    uint8_t *page = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (page)
+        return page;
+
+    if (heap_caps_get_free_size(MALLOC_CAP_INTERNAL) < size + SPOTIFY_TLS_SESSION_HEAP)
+        return nullptr;
+
+    return (uint8_t*)malloc(size);
+}
+
+/* Handed to the page prefetch task, lives on the stack of getPaged which waits for it. */
+struct SpotifyPageFetch {
+    SpotifyESP *spotify;
+    const String *endpoint;
+    int offset;
+    int limit;
+    uint8_t *items;
+    size_t itemSize;
+    const JsonDocument *filter;
+    const std::function<bool(JsonVariantConst element, void *item)> *parse;
+    int elements;
+    int stored;
+    int total;
+    const char *authorization;
+    SpotifyResult result;
+    SemaphoreHandle_t done; /* Not a task notification, the caller's callbacks may use those. */
+};
+
+SpotifyResult SpotifyESP::getPaged(const String &endpoint, size_t itemSize, int pageSize, const JsonDocument &filter, const SpotifyParseItem &parse, const SpotifyDeliverItem &deliver)
+{
+    /* The prefetch task gets its own copy of the token, a callback may refresh it while a page is in flight. */
+    char authorization[sizeof(_bearerToken)];
+
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    strlcpy(authorization, _bearerToken, sizeof(authorization));
+
+    /* Two pages of parsed items, one being read by the caller and one being fetched. Shrink the pages if memory is short. */
+    pageSize = min(pageSize, libraryPageSize);
+
+    uint8_t *pages[2] = { nullptr, nullptr };
+    while (pageSize > 0)
+    {
+        pages[0] = allocatePage(itemSize * pageSize);
+        if (pages[0])
+        {
+            pages[1] = allocatePage(itemSize * pageSize);
+            break;
+        }
+
+        pageSize /= 2;
+    }
+
+    if (!pages[0])
+        return SpotifyResult::eNoMemory;
+
+    SemaphoreHandle_t done = pages[1] ? xSemaphoreCreateBinary() : nullptr;
+    if (!done)
+        log_w("Not enough memory to prefetch pages, fetching them one after another");
+
+    int offset = 0;
+    int elements = 0, stored = 0, total = -1;
+    SpotifyResult result = fetchPage(endpoint, offset, pageSize, pages[0], itemSize, filter, parse, authorization, elements, stored, total);
+
+    int index = 0;
+    while (result == SpotifyResult::eSuccess)
+    {
+        /* Without a total, a page shorter than asked for is the last one. */
+        int nextOffset = offset + elements;
+        bool more = elements > 0 && (total >= 0 ? nextOffset < total : elements >= pageSize);
+
+        if (more && autoTokenRefresh)
+        {
+            checkAndRefreshAccessToken();
+            strlcpy(authorization, _bearerToken, sizeof(authorization));
+        }
+
+        /* Fetch the next page in the background while the caller works through this one. */
+        SpotifyPageFetch fetch = {};
+        bool prefetching = false;
+        if (more && done)
+        {
+            fetch.spotify = this;
+            fetch.endpoint = &endpoint;
+            fetch.offset = nextOffset;
+            fetch.limit = pageSize;
+            fetch.items = pages[1];
+            fetch.itemSize = itemSize;
+            fetch.filter = &filter;
+            fetch.parse = &parse;
+            fetch.authorization = authorization;
+            fetch.done = done;
+
+            prefetching = xTaskCreate(pageFetchTask, "spotifyPage", SPOTIFY_PAGE_PREFETCH_STACK, &fetch, 1, NULL) == pdPASS;
+        }
+
+        bool stopped = false;
+        for (int i = 0; i < stored && !stopped; i++)
+            stopped = !deliver(pages[0] + i * itemSize, index++, total);
+
+        if (prefetching)
+        {
+            /* The task always gives the semaphore, whatever happened to the request. */
+            xSemaphoreTake(done, portMAX_DELAY);
+
+            uint8_t *swap = pages[0];
+            pages[0] = pages[1];
+            pages[1] = swap;
+
+            result = fetch.result;
+            elements = fetch.elements;
+            stored = fetch.stored;
+            total = fetch.total;
+        }
+        else if (more && !stopped)
+        {
+            result = fetchPage(endpoint, nextOffset, pageSize, pages[0], itemSize, filter, parse, authorization, elements, stored, total);
+        }
+
+        if (stopped || !more)
+            break;
+
+        offset = nextOffset;
+    }
+
+    free(pages[0]);
+    free(pages[1]);
+
+    if (done)
+        vSemaphoreDelete(done);
+
+    return result;
+}
+
+void SpotifyESP::pageFetchTask(void *parameter)
+{
+    SpotifyPageFetch *fetch = static_cast<SpotifyPageFetch*>(parameter);
+
+    fetch->result = fetch->spotify->fetchPage(*fetch->endpoint, fetch->offset, fetch->limit, fetch->items, fetch->itemSize,
+        *fetch->filter, *fetch->parse, fetch->authorization, fetch->elements, fetch->stored, fetch->total);
+
+    xSemaphoreGive(fetch->done);
+    vTaskDelete(NULL);
+}
+
+SpotifyResult SpotifyESP::fetchPage(const String &endpoint, int offset, int limit, uint8_t *items, size_t itemSize, const JsonDocument &filter, const SpotifyParseItem &parse, const char *authorization, int &elements, int &stored, int &total)
+{
+    elements = 0;
+    stored = 0;
+    total = -1; /* Only known if it comes after the items. */
+
+    char paging[40];
+    snprintf(paging, sizeof(paging), "offset=%d&limit=%d", offset, limit);
+    String command = endpoint + paging;
+
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, command.c_str(), authorization, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eLibrary));
+    log_d("Status Code: %d", statusCode);
+
+    if (statusCode != 200)
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
+
+    SpotifyResult result = deserializeResponseArray(connection, "items", filter, [&](JsonVariantConst element) {
+        elements++;
+        if (stored < limit && parse(element, items + stored * itemSize))
+            stored++;
+
+        return true;
+    }, &total);
+
+    endRequest(connection);
+
+    log_d("Page at %d: %d items of %d", offset, elements, total);
+
+    return result;
+}
+
+SpotifyResult SpotifyESP::getRecentlyPlayed(SpotifyCallbackOnRecentlyPlayed callback, uint64_t after, int limit)
+{
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserReadRecentlyPlayed);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    char command[sizeof(SPOTIFY_RECENTLY_PLAYED_ENDPOINT) + 24];
+    snprintf(command, sizeof(command), SPOTIFY_RECENTLY_PLAYED_ENDPOINT, constrain(limit, 1, SPOTIFY_MAX_RECENTLY_PLAYED), after);
+
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, command, _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eRecentlyPlayed));
+    log_d("Status Code: %d", statusCode);
+
+    if (statusCode != 200)
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
+
+    StaticJsonDocument<384> filter;
+    filter["played_at"] = true;
+    trackFilter(filter.createNestedObject("track"));
+
+    int index = 0;
+    SpotifyResult result = deserializeResponseArray(connection, "items", filter, [&](JsonVariantConst element) {
+        SpotifyTrack track;
+        parseTrack(element["track"], track);
+        return callback(track, parseTimestamp(element["played_at"] | ""), index++, -1);
+    });
+
+    endRequest(connection);
+    return result;
+}
+
+SpotifyResult SpotifyESP::getQueue(SpotifyCallbackOnQueue callback, SpotifyQueueDiff *diff)
+{
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserReadCurrentlyPlaying | SpotifyScopeFlagBits::eUserReadPlaybackState);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    SpotifyConnection *connection = nullptr;
+    int statusCode = makeGetRequest(connection, SPOTIFY_QUEUE_ENDPOINT, _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eQueue));
+    log_d("Status Code: %d", statusCode);
+
+    if (statusCode != 200)
+    {
+        SpotifyResult result = processRegularError(statusCode, connection);
+        endRequest(connection);
+        return result;
+    }
+
+    /* Tracks and episodes are mixed together, ask for what either of them has. */
+    StaticJsonDocument<512> filter;
+    trackFilter(filter.to<JsonObject>());
+    filter["type"] = true;
+    filter["duration_ms"] = true;
+    filter["show"]["name"] = true;
+    filter["images"][0]["url"] = true;
+    filter["images"][0]["width"] = true;
+    filter["images"][0]["height"] = true;
+
+    static_assert(SPOTIFY_MAX_QUEUE_ITEMS <= 32, "Matched queue items are kept in a 32 bit mask");
+
+    uint32_t queue[SPOTIFY_MAX_QUEUE_ITEMS];
+    uint32_t matched = 0;
+    uint32_t current = 0;
+    bool stopped = false;
+    SpotifyQueueDiff changes = {};
+
+    SpotifyResult result = readResponse(connection, [&](Stream &source) {
+        /* Currently playing comes before the queue and is null when nothing is. */
+        if (!seekJsonKey(source, "currently_playing"))
+            return SpotifyResult::eJsonInvalidInput;
+
+        DynamicJsonDocument doc(catalogItemBufferSize);
+        DeserializationError error = deserializeJson(doc, source, DeserializationOption::Filter(filter));
+        if (error)
+            return processJsonError(error);
+
+        if (!doc.isNull())
+        {
+            SpotifyQueueItem item;
+            parseQueueItem(doc.as<JsonVariantConst>(), item);
+
+            current = SpotifyImageCache::hash(item.uri);
+            changes.currentChanged = current != _queueCurrent;
+
+            if (!callback(item, -1, changes.currentChanged ? SpotifyQueueChange::eAdded : SpotifyQueueChange::eUnchanged))
+            {
+                stopped = true;
+                return SpotifyResult::eSuccess;
+            }
+        }
+        else
+        {
+            changes.currentChanged = _queueCurrent != 0;
+        }
+
+        doc.clear();
+
+        return readJsonArray(source, "queue", filter, [&](JsonVariantConst element) {
+            SpotifyQueueItem item;
+            parseQueueItem(element, item);
+
+            int index = changes.count++;
+            uint32_t key = SpotifyImageCache::hash(item.uri);
+
+            /* The same track can be queued more than once, each old row only matches one new row. */
+            SpotifyQueueChange change = SpotifyQueueChange::eAdded;
+            if (index < _queueCount && _queue[index] == key && !(matched & (1u << index)))
+            {
+                matched |= 1u << index;
+                change = SpotifyQueueChange::eUnchanged;
+            }
+            else
+            {
+                for (int i = 0; i < _queueCount; i++)
+                {
+                    if (_queue[i] == key && !(matched & (1u << i)))
+                    {
+                        matched |= 1u << i;
+                        change = SpotifyQueueChange::eMoved;
+                        break;
+                    }
+                }
+            }
+
+            if (change == SpotifyQueueChange::eAdded)
+            {
+                changes.added++;
+                if (item.imageUrl[0])
+                    prefetchImage(item.imageUrl);
+            }
+            else if (change == SpotifyQueueChange::eMoved)
+            {
+                changes.moved++;
+            }
+
+            if (index < SPOTIFY_MAX_QUEUE_ITEMS)
+                queue[index] = key;
+
+            stopped = !callback(item, index, change);
+            return !stopped;
+        });
+    });
+
+    endRequest(connection);
+
+    if (result != SpotifyResult::eSuccess || stopped)
+        return result;
+
+    changes.removed = _queueCount - __builtin_popcount(matched);
+
+    _queueCount = min(changes.count, SPOTIFY_MAX_QUEUE_ITEMS);
+    memcpy(_queue, queue, _queueCount * sizeof(queue[0]));
+    _queueCurrent = current;
+
+    log_d("Queue has %d items, %d added, %d moved and %d removed", changes.count, changes.added, changes.moved, changes.removed);
+
+    if (diff)
+        *diff = changes;
+
+    return result;
+}
+
+void SpotifyESP::resetQueue()
+{
+    _queueCount = 0;
+    _queueCurrent = 0;
+}
+
+SpotifyResult SpotifyESP::addToQueue(const char *const *uris, int count, const char *deviceId, int *queued)
+{
+    if (queued)
+        *queued = 0;
+
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserModifyPlaybackState, true);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    deviceId = resolveDeviceId(deviceId);
+    if (!deviceId)
+        return SpotifyResult::eDeviceNotFound;
+
+    /* Keep the socket open between the requests, the pool hands the same connection back each time. */
+    if (count > 1)
+        _connections.warm(SPOTIFY_HOST, SPOTIFY_WARM_IDLE_TIMEOUT);
+
+    char command[sizeof(SPOTIFY_QUEUE_ENDPOINT) + SPOTIFY_URI_CHAR_LENGTH + SPOTIFY_DEVICE_ID_CHAR_LENGTH + 16];
+
+    for (int i = 0; i < count; i++)
+    {
+        int written = deviceId[0]
+            ? snprintf(command, sizeof(command), SPOTIFY_QUEUE_ENDPOINT "?uri=%s&device_id=%s", uris[i], deviceId)
+            : snprintf(command, sizeof(command), SPOTIFY_QUEUE_ENDPOINT "?uri=%s", uris[i]);
+
+        if (written >= (int)sizeof(command))
+        {
+            log_e("%s is too long to queue", uris[i]);
+            return SpotifyResult::eInvalidRequest;
+        }
+
+        if (autoTokenRefresh)
+            checkAndRefreshAccessToken();
+
+        SpotifyConnection *connection = nullptr;
+        int statusCode = makePostRequest(connection, command, _bearerToken);
+
+        SpotifyResult result = (statusCode == 200 || statusCode == 204)
+            ? SpotifyResult::eSuccess
+            : processRegularError(statusCode, connection);
+
+        /* A 200 may still carry a body, skip it so the next request can reuse the socket. */
+        if (result == SpotifyResult::eSuccess)
+            drainResponse(connection, 0);
+
+        endRequest(connection);
+
+        if (result != SpotifyResult::eSuccess)
+            return result;
+
+        if (queued)
+            (*queued)++;
+    }
+
+    return SpotifyResult::eSuccess;
+}
+
+SpotifyResult SpotifyESP::saveTracks(const char *const *uris, int count, int *saved)
+{
+    return writeLibraryTracks("PUT", uris, count, saved);
+}
+
+SpotifyResult SpotifyESP::removeSavedTracks(const char *const *uris, int count, int *removed)
+{
+    return writeLibraryTracks("DELETE", uris, count, removed);
+}
+
+SpotifyResult SpotifyESP::writeLibraryTracks(const char *type, const char *const *uris, int count, int *written)
+{
+    if (written)
+        *written = 0;
+
+    SpotifyResult access = checkAccess((SpotifyScopeFlags)SpotifyScopeFlagBits::eUserLibraryModify);
+    if (access != SpotifyResult::eSuccess)
+        return access;
+
+    if (count > SPOTIFY_MAX_SAVED_TRACKS_PER_REQUEST)
+        _connections.warm(SPOTIFY_HOST, SPOTIFY_WARM_IDLE_TIMEOUT);
+
+    for (int first = 0; first < count; first += SPOTIFY_MAX_SAVED_TRACKS_PER_REQUEST)
+    {
+        SpotifyIdsRequest body(uris + first, min(count - first, SPOTIFY_MAX_SAVED_TRACKS_PER_REQUEST));
+        if (!body.valid())
+            return SpotifyResult::eInvalidRequest;
+
+        if (autoTokenRefresh)
+            checkAndRefreshAccessToken();
+
+        SpotifyConnection *connection = nullptr;
+        int statusCode = makeRequestWithBody(connection, type, SPOTIFY_LIBRARY_TRACKS_ENDPOINT, _bearerToken, body);
+        log_d("Status Code: %d", statusCode);
+
+        SpotifyResult result = (statusCode == 200 || statusCode == 204)
+            ? SpotifyResult::eSuccess
+            : processRegularError(statusCode, connection);
+
+        /* A 200 may still carry a body, skip it so the next request can reuse the socket. */
+        if (result == SpotifyResult::eSuccess)
+            drainResponse(connection, 0);
+
+        endRequest(connection);
+
+        if (result != SpotifyResult::eSuccess)
+            return result;
+
+        if (written)
+            *written += min(count - first, SPOTIFY_MAX_SAVED_TRACKS_PER_REQUEST);
+    }
+
+    return SpotifyResult::eSuccess;
+}
+
+SpotifyResult SpotifyESP::getSeveral(const char *endpoint, const char *key, const char *const *uris, int count, int batchSize, const char *market, const JsonDocument &filter, const std::function<bool(JsonVariantConst item, int index)> &callback)
+{
+    if (autoTokenRefresh)
+        checkAndRefreshAccessToken();
+
+    String command;
+    command.reserve(strlen(endpoint) + batchSize * SPOTIFY_ID_CHAR_LENGTH + 16);
+
+    for (int first = 0; first < count; first += batchSize)
+    {
+        int last = min(first + batchSize, count);
+
+        command = endpoint;
+        for (int i = first; i < last; i++)
+        {
+            if (i > first)
+                command += ',';
+            command += idFromUri(uris[i]);
+        }
+
+        if (market && market[0])
+        {
+            command += "&market=";
+            command += market;
+        }
+
+        SpotifyConnection *connection = nullptr;
+        int statusCode = makeGetRequest(connection, command.c_str(), _bearerToken, "application/json", SPOTIFY_HOST, wantsCompression(SpotifyEndpointFlagBits::eCatalog));
+        log_d("Status Code: %d", statusCode);
+
+        if (statusCode != 200)
+        {
+            SpotifyResult result = processRegularError(statusCode, connection);
+            endRequest(connection);
+            return result;
+        }
+
+        /* Items Spotify doesn't know come back as null, they still take up their place. */
+        int index = first;
+        bool keepGoing = true;
+        SpotifyResult result = deserializeResponseArray(connection, key, filter, [&](JsonVariantConst element) {
+            int position = index++;
+            if (element.isNull())
+                return true;
+
+            keepGoing = callback(element, position);
+            return keepGoing;
+        });
+
+        endRequest(connection);
+
+        if (result != SpotifyResult::eSuccess || !keepGoing)
+            return result;
+    }
+
+    return SpotifyResult::eSuccess;
+}
+
+SpotifyResult SpotifyESP::deserializeResponseArray(SpotifyConnection *connection, const char *key, const JsonDocument &filter, const std::function<bool(JsonVariantConst element)> &callback, int *total)
+{
+    return readResponse(connection, [&](Stream &source) {
+        return readJsonArray(source, key, filter, callback, total);
+    });
+}
+
+SpotifyResult SpotifyESP::readResponse(SpotifyConnection *connection, const std::function<SpotifyResult(Stream &source)> &reader)
+{
+    SpotifyBufferedStream stream(connection->httpClient->getStream(), jsonStreamBlockSize);
+
+    String contentEncoding = connection->httpClient->header("Content-Encoding");
+    bool compressed = !contentEncoding.isEmpty() && !contentEncoding.equalsIgnoreCase("identity");
+
+    SpotifyInflateStream *inflated = nullptr;
+    if (compressed)
+    {
+        inflated = new (std::nothrow) SpotifyInflateStream(stream, contentEncoding.equalsIgnoreCase("gzip") 
+            ? SpotifyContentEncoding::eGzip 
+            : SpotifyContentEncoding::eDeflate);
+
+        if (!inflated)
+            return SpotifyResult::eNoMemory;
+
+        if (!inflated->valid())
+        {
+            delete inflated;
+            return SpotifyResult::eJsonInvalidInput;
+        }
+    }
+
+    SpotifyResult result = reader(inflated ? (Stream&)*inflated : (Stream&)stream);
+
+    if (inflated)
+    {
+        addCompressionStats(*inflated);
+        delete inflated;
+    }
+
+    /* A callback that stopped early leaves the rest of the body behind. */
+    if (result == SpotifyResult::eSuccess)
+        drainResponse(connection, stream.received());
+
+    return result;
+}
+
+SpotifyResult SpotifyESP::readJsonArray(Stream &source, const char *key, const JsonDocument &filter, const std::function<bool(JsonVariantConst element)> &callback, int *total)
+{
+    if (!seekJsonArray(source, key))
+    {
+        log_e("No \"%s\" array in the response", key);
+        return SpotifyResult::eJsonInvalidInput;
+    }
+
+    DynamicJsonDocument doc(catalogItemBufferSize);
+
+    while (true)
+    {
+        /* Between elements there is only whitespace and commas, then the closing bracket. */
+        int c = source.peek();
+        while (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',')
+        {
+            source.read();
+            c = source.peek();
+        }
+
+        if (c == ']')
+        {
+            source.read();
+
+            /* Paging objects put their total after the items. */
+            if (total && source.find("\"total\""))
+            {
+                source.find(":");
+                *total = source.parseInt();
+            }
+
+            return SpotifyResult::eSuccess;
+        }
+
+        if (c < 0)
+            return SpotifyResult::eJsonIncompleteInput;
+
+        DeserializationError error = deserializeJson(doc, source, DeserializationOption::Filter(filter));
+        if (error)
+            return processJsonError(error);
+
+        if (!callback(doc.as<JsonVariantConst>()))
+            return SpotifyResult::eSuccess;
+    }
+}
+
+bool SpotifyESP::seekJsonKey(Stream &stream, const char *key)
+{
+    char quoted[SPOTIFY_NAME_CHAR_LENGTH];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+
+    if (!stream.find(quoted))
+        return false;
+
+    /* Spotify pretty prints its responses, there may be spaces around the colon. */
+    int c;
+    do { c = stream.read(); } while (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+    if (c != ':')
+        return false;
+
+    c = stream.peek();
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+    {
+        stream.read();
+        c = stream.peek();
+    }
+
+    return c >= 0;
+}
+
+bool SpotifyESP::seekJsonArray(Stream &stream, const char *key)
+{
+    return seekJsonKey(stream, key) && stream.read() == '[';
+}
+
+int SpotifyESP::readJsonToken(Stream &stream)
+{
+    int c;
+    do { c = stream.read(); } while (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+    return c;
+}
+
+bool SpotifyESP::skipJsonObject(Stream &stream)
+{
+    /* Reads up to and including the brace that closes the object the stream is in. */
+    int depth = 0;
+    bool inString = false;
+
+    while (true)
+    {
+        int c = stream.read();
+        if (c < 0)
+            return false;
+
+        if (inString)
+        {
+            if (c == '\\')
+                stream.read();
+            else if (c == '"')
+                inString = false;
+        }
+        else if (c == '"')
+        {
+            inString = true;
+        }
+        else if (c == '{' || c == '[')
+        {
+            depth++;
+        }
+        else if (c == '}' || c == ']')
+        {
+            if (depth-- == 0)
+                return c == '}';
+        }
+    }
+}
+
+const char* SpotifyESP::idFromUri(const char *uri)
+{
+    /* A URI's id is everything after its last colon, a bare id has none. */
+    const char *colon = strrchr(uri, ':');
+    return colon ? colon + 1 : uri;
+}
+
+void SpotifyESP::trackFilter(JsonObject filter)
+{
+    filter["name"] = true;
+    filter["uri"] = true;
+    filter["album"]["name"] = true;
+    filter["album"]["uri"] = true;
+    filter["album"]["images"][0]["url"] = true;
+    filter["album"]["images"][0]["width"] = true;
+    filter["album"]["images"][0]["height"] = true;
+    filter["artists"][0]["name"] = true;
+    filter["artists"][0]["uri"] = true;
+}
+
+void SpotifyESP::albumFilter(JsonObject filter)
+{
+    filter["name"] = true;
+    filter["uri"] = true;
+    filter["total_tracks"] = true;
+    filter["images"][0]["url"] = true;
+    filter["images"][0]["width"] = true;
+    filter["images"][0]["height"] = true;
+    filter["artists"][0]["name"] = true;
+    filter["artists"][0]["uri"] = true;
+}
+
+void SpotifyESP::playlistFilter(JsonObject filter)
+{
+    filter["name"] = true;
+    filter["uri"] = true;
+    filter["id"] = true;
+    filter["snapshot_id"] = true;
+    filter["owner"]["display_name"] = true;
+    filter["tracks"]["total"] = true;
+    filter["images"][0]["url"] = true;
+    filter["images"][0]["width"] = true;
+    filter["images"][0]["height"] = true;
+}
+
+void SpotifyESP::parseArtists(JsonVariantConst artists, SpotifyArtist *result, int &numArtists)
+{
+    numArtists = min((int)artists.size(), SPOTIFY_MAX_NUM_ARTISTS);
+
+    for (int i = 0; i < numArtists; i++)
+    {
+        memset(&result[i], 0, sizeof(result[i]));
+        strncpy(result[i].artistName, artists[i]["name"] | "", sizeof(result[i].artistName)-1);
+        strncpy(result[i].artistUri, artists[i]["uri"] | "", sizeof(result[i].artistUri)-1);
+    }
+}
+
+void SpotifyESP::parseImages(JsonVariantConst images, SpotifyImage *result, int &numImages)
+{
+    numImages = min((int)images.size(), SPOTIFY_NUM_ALBUM_IMAGES);
+
+    for (int i = 0; i < numImages; i++)
+    {
+        memset(&result[i], 0, sizeof(result[i]));
+        result[i].height = images[i]["height"] | 0;
+        result[i].width = images[i]["width"] | 0;
+        strncpy(result[i].url, images[i]["url"] | "", sizeof(result[i].url)-1);
+    }
+}
+
+void SpotifyESP::parseAlbum(JsonVariantConst album, SpotifyAlbum &result)
+{
+    memset(&result, 0, sizeof(result));
+    strncpy(result.albumName, album["name"] | "", sizeof(result.albumName)-1);
+    strncpy(result.albumUri, album["uri"] | "", sizeof(result.albumUri)-1);
+    result.totalTracks = album["total_tracks"] | 0;
+
+    parseArtists(album["artists"], result.artists, result.numArtists);
+    parseImages(album["images"], result.albumImages, result.numImages);
+}
+
+void SpotifyESP::parsePlaylist(JsonVariantConst playlist, SpotifyPlaylist &result)
+{
+    memset(&result, 0, sizeof(result));
+    strncpy(result.playlistName, playlist["name"] | "", sizeof(result.playlistName)-1);
+    strncpy(result.playlistUri, playlist["uri"] | "", sizeof(result.playlistUri)-1);
+    strncpy(result.playlistId, playlist["id"] | "", sizeof(result.playlistId)-1);
+    strncpy(result.snapshotId, playlist["snapshot_id"] | "", sizeof(result.snapshotId)-1);
+    strncpy(result.ownerName, playlist["owner"]["display_name"] | "", sizeof(result.ownerName)-1);
+    result.totalTracks = playlist["tracks"]["total"] | 0;
+
+    parseImages(playlist["images"], result.images, result.numImages);
+}
+
+void SpotifyESP::parseQueueItem(JsonVariantConst item, SpotifyQueueItem &result)
+{
+    memset(&result, 0, sizeof(result));
+    strncpy(result.name, item["name"] | "", sizeof(result.name)-1);
+    strncpy(result.uri, item["uri"] | "", sizeof(result.uri)-1);
+    result.durationMs = item["duration_ms"] | 0L;
+
+    SpotifyImage images[SPOTIFY_NUM_ALBUM_IMAGES];
+    int numImages;
+
+    if (strcmp(item["type"] | "", "episode") == 0)
+    {
+        result.type = SpotifyPlayingType::eEpisode;
+        strncpy(result.artistName, item["show"]["name"] | "", sizeof(result.artistName)-1);
+        parseImages(item["images"], images, numImages);
+    }
+    else
+    {
+        result.type = SpotifyPlayingType::eTrack;
+        strncpy(result.artistName, item["artists"][0]["name"] | "", sizeof(result.artistName)-1);
+        parseImages(item["album"]["images"], images, numImages);
+    }
+
+    const SpotifyImage *image = selectImage(images, numImages);
+    if (image)
+        strncpy(result.imageUrl, image->url, sizeof(result.imageUrl)-1);
+}
+
+uint64_t SpotifyESP::parseTimestamp(const char *timestamp)
+{
+    /* ISO 8601 in UTC, like "2024-05-01T12:34:56.789Z", the fraction is optional. */
+    int year, month, day, hour, minute, second;
+    if (sscanf(timestamp, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6)
+        return 0;
+
+    int milliseconds = 0;
+    const char *fraction = strchr(timestamp, '.');
+    if (fraction)
+    {
+        int digits = 0;
+        for (fraction++; isdigit(*fraction) && digits < 3; fraction++, digits++)
+            milliseconds = milliseconds * 10 + (*fraction - '0');
+
+        for (; digits < 3; digits++)
+            milliseconds *= 10;
+    }
+
+    /* Days since 1970-01-01 of a civil date, Howard Hinnant's algorithm. */
+    year -= month <= 2;
+    int era = year / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    int64_t days = (int64_t)era * 146097 + dayOfEra - 719468;
+
+    return (uint64_t)(((days * 24 + hour) * 60 + minute) * 60 + second) * 1000 + milliseconds;
+}
+
+void SpotifyESP::parseTrack(JsonVariantConst track, SpotifyTrack &result)
+{
+    memset(&result, 0, sizeof(result));
+    strncpy(result.trackUri, track["uri"] | "", sizeof(result.trackUri)-1);
+    strncpy(result.trackName, track["name"] | "", sizeof(result.trackName)-1);
+    strncpy(result.albumUri, track["album"]["uri"] | "", sizeof(result.albumUri)-1);
+    strncpy(result.albumName, track["album"]["name"] | "", sizeof(result.albumName)-1);
+
+    parseArtists(track["artists"], result.artists, result.numArtists);
+    parseImages(track["album"]["images"], result.albumImages, result.numImages);
+}
+
+SpotifyResult SpotifyESP::requestImage(char* imageUrl, size_t* length)
+{
+    log_d("Parsing image URL: %s", imageUrl);
+    uint8_t lengthOfString = strlen(imageUrl);
 
     // We are going to just assume https, that's all I've
     // seen and I can't imagine a company will go back
@@ -1030,108 +2898,589 @@ SpotifyResult SpotifyESP::requestImage(char* imageUrl, size_t* length)
     log_i("path: %s", path);
     log_i("len:path: %d", strlen(path));
 
-    int statusCode = makeGetRequest(path, NULL, "text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8", host);
+    /* Only one image is read at a time, drop the last one if it wasn't read. */
+    endImage();
+
+    /* Kept to resume the download if it drops, too long and it just won't resume. */
+    _imageHost[0] = '\0';
+    _imagePath[0] = '\0';
+    if (hostLength < sizeof(_imageHost) && pathLength < sizeof(_imagePath))
+    {
+        strcpy(_imageHost, host);
+        strcpy(_imagePath, path);
+    }
+
+    _imageKey = SpotifyImageCache::hash(imageUrl);
+
+    if (_imageMemoryCache)
+    {
+        size_t cachedLength = 0;
+        _imageMemory = _imageMemoryCache->find(_imageKey, &cachedLength);
+        if (_imageMemory)
+        {
+            log_d("Image is cached in memory");
+            _imageLength = cachedLength;
+            *length = cachedLength;
+            return SpotifyResult::eSuccess;
+        }
+    }
+
+    if (_imageCache)
+    {
+        size_t cachedLength = 0;
+        _imageFile = _imageCache->open(_imageKey, &cachedLength);
+        if (_imageFile)
+        {
+            log_d("Image is cached on flash");
+            _imageLength = cachedLength;
+            *length = cachedLength;
+
+            if (_imageMemoryCache)
+                _imageMemoryCopy = _imageMemoryCache->reserve(_imageLength);
+
+            return SpotifyResult::eSuccess;
+        }
+    }
+
+    int statusCode = makeGetRequest(_imageConnection, path, NULL, imageAcceptHeader, host);
     log_d("statusCode: %d", statusCode);
 
     if (statusCode != 200)
-        return processRegularError(statusCode);
+    {
+        SpotifyResult result = processRegularError(statusCode, _imageConnection);
+        endRequest(_imageConnection);
+        return result;
+    }
 
-    _imageLength = _httpClient->getSize();
+    _imageLength = _imageConnection->httpClient->getSize();
     *length = _imageLength;
 
     log_d("file length: %d", _imageLength);
 
+    if (_imageCache && _imageLength > 0)
+        _imageCacheFile = _imageCache->create(_imageKey);
+
+    if (_imageMemoryCache && _imageLength > 0)
+        _imageMemoryCopy = _imageMemoryCache->reserve(_imageLength);
+
     return SpotifyResult::eSuccess;
 }
 
+void SpotifyESP::setImageCache(SpotifyImageCache *imageCache)
+{
+    endImage();
+    _imageCache = imageCache;
+}
+
 SpotifyResult SpotifyESP::getImage(Stream *file)
 {
-    if (_imageLength > 0)
+    return readImage(nullptr, 0, [file](const uint8_t *data, size_t length) {
+        file->write(data, length);
+        return true;
+    });
+}
+
+SpotifyResult SpotifyESP::getImage(uint8_t *image)
+{
+    /* Without a capacity the image length is all we can go by, refuse to guess. */
+    return readImage(image, (_imageLength > 0) ? _imageLength : 0, nullptr);
+}
+
+SpotifyResult SpotifyESP::getImage(uint8_t *image, size_t capacity)
+{
+    return readImage(image, capacity, nullptr);
+}
+
+SpotifyResult SpotifyESP::getImage(SpotifyCallbackOnImageData callback)
+{
+    return readImage(nullptr, 0, callback);
+}
+
+SpotifyImageTransferStats SpotifyESP::getImageTransferStats()
+{
+    return _imageTransfer;
+}
+
+SpotifyResult SpotifyESP::getImageRGB565(char *imageUrl, uint16_t *framebuffer, int width, int height)
+{
+    size_t frameSize = SpotifyThumbnail::framebufferSize(width, height);
+
+    /* The decoded pixels are cached under their own key, one per size, and apart from the JPEGs on flash. */
+    uint32_t key = SpotifyThumbnail::key(imageUrl, width, height);
+
+    if (_imageMemoryCache)
     {
-        int remaining = _imageLength;
+        size_t cachedLength = 0;
+        const uint8_t *cached = _imageMemoryCache->find(key, &cachedLength);
+        if (cached && cachedLength == frameSize)
+        {
+            memcpy(framebuffer, cached, frameSize);
+            return SpotifyResult::eSuccess;
+        }
+    }
 
-        // This section of code is inspired but the "Web_Jpg"
-        // example of TJpg_Decoder
-        // https://github.com/Bodmer/TJpg_Decoder
-        // -----------
-        uint8_t buff[128] = {0};
-        while (_httpClient->connected() && (remaining > 0 || remaining == -1))
+    if (_imageCache)
+    {
+        size_t cachedLength = 0;
+        fs::File file = _imageCache->open(key, &cachedLength, SpotifyImageFormat::eRgb565);
+        if (file)
         {
-            // Get available data size
-            size_t size = _httpClient->getStream().available();
+            bool read = cachedLength == frameSize && file.read((uint8_t*)framebuffer, frameSize) == frameSize;
+            file.close();
 
-            if (size)
+            if (read)
             {
-                // Read up to 128 bytes
-                int c = _httpClient->getStream().readBytes(buff, ((size > sizeof(buff)) ? sizeof(buff) : size));
+                log_d("Thumbnail read from flash");
+                storeThumbnail(key, framebuffer, frameSize, false);
+                return SpotifyResult::eSuccess;
+            }
+        }
+    }
 
-                // Write it to file
-                file->write(buff, c);
+    if (!SpotifyThumbnail::canDecode())
+        return SpotifyResult::eInvalidImage;
 
-                // Calculate remaining bytes
-                if (remaining > 0)
-                {
-                    remaining -= c;
-                }
-            }
+    size_t length = 0;
+    SpotifyResult result = requestImage(imageUrl, &length);
+    if (result != SpotifyResult::eSuccess)
+        return result;
+
+    /* The decoder needs the whole JPEG, so it has to have a length. */
+    if (_imageLength <= 0)
+    {
+        endImage();
+        return SpotifyResult::eInvalidImage;
+    }
+
+    uint8_t *jpeg = (uint8_t*)heap_caps_malloc(length, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!jpeg)
+        jpeg = (uint8_t*)malloc(length);
+
+    if (!jpeg)
+    {
+        log_e("Not enough memory for a %d byte image", length);
+        endImage();
+        return SpotifyResult::eNoMemory;
+    }
+
+    result = getImage(jpeg, length);
+    bool decoded = result == SpotifyResult::eSuccess && SpotifyThumbnail::decode(jpeg, length, framebuffer, width, height);
+    free(jpeg);
+
+    if (result != SpotifyResult::eSuccess)
+        return result;
+
+    if (!decoded)
+        return SpotifyResult::eInvalidImage;
+
+    storeThumbnail(key, framebuffer, frameSize, true);
+    return SpotifyResult::eSuccess;
+}
+
+void SpotifyESP::storeThumbnail(uint32_t key, const uint16_t *framebuffer, size_t frameSize, bool toFlash)
+{
+    if (toFlash && _imageCache)
+    {
+        fs::File file = _imageCache->create(key, SpotifyImageFormat::eRgb565);
+        if (file)
+        {
+            size_t written = file.write((const uint8_t*)framebuffer, frameSize);
+
+            /* A short write commits nothing, the temporary file is removed. */
+            _imageCache->commit(key, file, (written == frameSize) ? written : 0, SpotifyImageFormat::eRgb565);
+        }
+    }
 
-            yield();
+    if (_imageMemoryCache)
+    {
+        uint8_t *copy = _imageMemoryCache->reserve(frameSize);
+        if (copy)
+        {
+            memcpy(copy, framebuffer, frameSize);
+            _imageMemoryCache->insert(key, copy, frameSize);
         }
-// ---------
-        log_d("Finished getting image");
     }
+}
+
+const SpotifyImage* SpotifyESP::selectImage(const SpotifyImage *images, int numImages)
+{
+    return selectImage(images, numImages, displayWidth, displayHeight);
+}
+
+const SpotifyImage* SpotifyESP::selectImage(const SpotifyImage *images, int numImages, int width, int height)
+{
+    const SpotifyImage *covering = nullptr;
+    const SpotifyImage *largest = nullptr;
+
+    for (int i = 0; i < numImages; i++)
+    {
+        const SpotifyImage *image = &images[i];
 
-    _httpClient->end();
+        if (!largest || image->width > largest->width)
+            largest = image;
 
-    return (_imageLength > 0) ? SpotifyResult::eSuccess : SpotifyResult::eInvalidImage; //Probably could be improved!
+        if (image->width >= width && image->height >= height && (!covering || image->width < covering->width))
+            covering = image;
+    }
+
+    return covering ? covering : largest;
 }
 
-SpotifyResult SpotifyESP::getImage(uint8_t *image)
+bool SpotifyESP::prefetchImage(const char *imageUrl)
+{
+    if (!_imageCache && !_imageMemoryCache)
+        return false;
+
+    uint32_t key = SpotifyImageCache::hash(imageUrl);
+    if (_imageMemoryCache ? _imageMemoryCache->contains(key) : _imageCache->contains(key))
+        return true;
+
+    for (int i = 0; i < _prefetchCount; i++)
+        if (strcmp(_prefetch[i], imageUrl) == 0)
+            return true;
+
+    if (_prefetchCount >= SPOTIFY_PREFETCH_IMAGES || strlen(imageUrl) >= SPOTIFY_URL_CHAR_LENGTH)
+        return false;
+
+    strcpy(_prefetch[_prefetchCount++], imageUrl);
+    return true;
+}
+
+bool SpotifyESP::prefetchImages()
+{
+    /* Don't pull an image out from under the sketch. */
+    if (_prefetchCount == 0 || _imageConnection || _imageFile || _imageMemory)
+        return false;
+
+    char url[SPOTIFY_URL_CHAR_LENGTH];
+    strcpy(url, _prefetch[0]);
+
+    _prefetchCount--;
+    memmove(_prefetch[0], _prefetch[1], _prefetchCount * sizeof(_prefetch[0]));
+
+    uint32_t key = SpotifyImageCache::hash(url);
+    if (_imageMemoryCache ? _imageMemoryCache->contains(key) : _imageCache->contains(key))
+        return false;
+
+    log_d("Prefetching %s", url);
+
+    size_t length;
+    if (requestImage(url, &length) != SpotifyResult::eSuccess)
+        return false;
+
+    /* Reading it is enough, the caches keep a copy on the way through. */
+    return getImage([](const uint8_t*, size_t) { return true; }) == SpotifyResult::eSuccess;
+}
+
+SpotifyResult SpotifyESP::readImage(uint8_t *buffer, size_t capacity, const SpotifyCallbackOnImageData &sink)
 {
-    #define SPOTIFY_IMAGE_READ_LENGTH 128
+    if (buffer && _imageLength > 0 && (size_t)_imageLength > capacity)
+    {
+        log_e("Image is %d bytes, the buffer only holds %d", _imageLength, capacity);
+        endImage();
+        return SpotifyResult::eImageBufferTooSmall;
+    }
+
+    /* Cached in memory, hand the bytes over without touching flash or the network. */
+    if (_imageMemory)
+    {
+        if (buffer)
+            memcpy(buffer, _imageMemory, _imageLength);
+
+        if (sink)
+            sink(_imageMemory, _imageLength);
+
+        _imageMemory = nullptr;
+        return SpotifyResult::eSuccess;
+    }
+
+    if (!_imageFile && !_imageConnection)
+        return SpotifyResult::eInvalidImage;
+
+    /* Reads into a caller's buffer go straight there, otherwise through a block. */
+    uint8_t fallbackBlock[SPOTIFY_IMAGE_READ_LENGTH];
+    uint8_t *heapBlock = nullptr;
+    uint8_t *block = fallbackBlock;
+    size_t blockSize = sizeof(fallbackBlock);
+
+    if (buffer)
+    {
+        blockSize = max(imageBlockSize, (size_t)SPOTIFY_IMAGE_READ_LENGTH);
+    }
+    else if (imageBlockSize > SPOTIFY_IMAGE_READ_LENGTH)
+    {
+        heapBlock = (uint8_t*)malloc(imageBlockSize);
+        if (heapBlock)
+        {
+            block = heapBlock;
+            blockSize = imageBlockSize;
+        }
+        else
+        {
+            log_w("Could not allocate a %d byte image block, reading in %d byte blocks", imageBlockSize, sizeof(fallbackBlock));
+        }
+    }
+
+    size_t received = 0;
+    bool stopped = false;
+    bool timedOut = false;
+    bool tooLarge = false;
+
+    /* Cached on flash, the whole image is already there. */
+    if (_imageFile)
+    {
+        while (received < (size_t)_imageLength)
+        {
+            uint8_t *destination = buffer ? buffer + received : block;
+            int c = _imageFile.read(destination, min(_imageLength - received, blockSize));
+            if (c <= 0)
+                break;
+
+            copyImageChunk(destination, received, c);
+            received += c;
+
+            if (sink && !sink(destination, c))
+            {
+                stopped = true;
+                break;
+            }
+        }
 
-    /* Get the image from Spotify. */
+        _imageFile.close();
 
-    if (_imageLength > 0)
+        log_d("Read %d bytes of image from flash", received);
+    }
+    else
     {
-        int remaining = _imageLength;
-        int amountRead = 0;
+        unsigned long start = millis();
+        unsigned long lastData = start;
+        int resumes = 0;
 
         log_d("Fetching Image");
 
-        // This section of code is inspired but the "Web_Jpg"
-        // example of TJpg_Decoder
-        // https://github.com/Bodmer/TJpg_Decoder
-        // -----------
-        while (_httpClient->connected() && (remaining > 0 || remaining == -1))
+        while (true)
         {
-            // Get available data size
-            size_t size = _httpClient->getStream().available();
-            
-            if (size)
+            WiFiClient &client = _imageConnection->httpClient->getStream();
+
+            /* An unknown length (-1) is read until the server closes the connection. */
+            while (_imageLength < 0 || received < (size_t)_imageLength)
             {
-                // Read up to 128 bytes
-                int readLength = ((size > SPOTIFY_IMAGE_READ_LENGTH) ? SPOTIFY_IMAGE_READ_LENGTH : size);
+                int size = client.available();
+
+                if (size <= 0)
+                {
+                    if (!client.connected())
+                        break;
+
+                    if (millis() - lastData >= SPOTIFY_TIMEOUT)
+                    {
+                        timedOut = true;
+                        break;
+                    }
+
+                    /* Let the network task fill the TLS buffer instead of spinning. */
+                    delay(1);
+                    continue;
+                }
+
+                size_t wanted = min((size_t)size, blockSize);
+                if (_imageLength > 0)
+                    wanted = min(wanted, _imageLength - received);
+
+                if (buffer)
+                {
+                    if (received >= capacity)
+                    {
+                        tooLarge = true;
+                        break;
+                    }
+
+                    wanted = min(wanted, capacity - received);
+                }
+
+                // Read whatever TLS has decrypted, up to a block, in one go
+                uint8_t *destination = buffer ? buffer + received : block;
+                int c = client.read(destination, wanted);
+                if (c <= 0)
+                    break;
+
+                lastData = millis();
+
+                // Keep a copy for next time
+                if (_imageCacheFile)
+                    _imageCacheFile.write(destination, c);
 
-                int c = _httpClient->getStream().readBytes(image + amountRead, readLength);
+                copyImageChunk(destination, received, c);
+                received += c;
 
-                // Calculate remaining bytes
-                if (remaining > 0)
+                if (sink && !sink(destination, c))
                 {
-                    amountRead += c;
-                    remaining -= c;
+                    log_d("Image read stopped by the callback");
+                    stopped = true;
+                    break;
                 }
             }
 
-            yield();
+            /* Pick up where the transfer dropped, the buffer, cache file and sink just carry on. */
+            bool interrupted = _imageLength > 0 && received < (size_t)_imageLength && !stopped && !tooLarge;
+            if (!interrupted || resumes >= imageResumeAttempts)
+                break;
+
+            resumes++;
+            log_w("Image transfer dropped at %d of %d bytes, resuming (%d)", received, _imageLength, resumes);
+
+            if (!resumeImage(received, buffer ? buffer + received : block, buffer ? capacity - received : blockSize))
+                break;
+
+            timedOut = false;
+            lastData = millis();
+        }
+
+        _imageTransfer.bytes = received;
+        _imageTransfer.durationMs = lastData - start;
+        _imageTransfer.bytesPerSecond = _imageTransfer.durationMs ? (uint64_t)received * 1000 / _imageTransfer.durationMs : 0;
+        _imageTransfer.resumes = resumes;
+
+        log_d("Finished getting image, %d bytes at %d bytes/s", received, _imageTransfer.bytesPerSecond);
+    }
+
+    free(heapBlock);
+
+    finishImage(received);
+
+    /* A download that stopped short leaves the rest of the image on the socket. */
+    if (_imageConnection && _imageLength > 0 && received == (size_t)_imageLength)
+        _imageConnection->bodyRead = true;
+
+    endRequest(_imageConnection);
+
+    if (tooLarge)
+    {
+        log_e("Image didn't fit in the %d byte buffer", capacity);
+        return SpotifyResult::eImageBufferTooSmall;
+    }
+
+    if (timedOut)
+    {
+        log_e("Timed out reading the image after %d bytes", received);
+        return SpotifyResult::eTimeout;
+    }
+
+    if (received == 0 || (!stopped && _imageLength > 0 && received != (size_t)_imageLength))
+        return SpotifyResult::eInvalidImage;
+
+    return SpotifyResult::eSuccess;
+}
+
+bool SpotifyESP::resumeImage(size_t offset, uint8_t *scratch, size_t scratchSize)
+{
+    /* The old socket may still be half open, don't let it be kept alive. */
+    if (_imageConnection)
+        _imageConnection->wifiClient->stop();
+
+    endRequest(_imageConnection);
+
+    if (!_imagePath[0])
+        return false;
+
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%u-", offset);
+
+    int statusCode = makeGetRequest(_imageConnection, _imagePath, NULL, imageAcceptHeader, _imageHost, false, range);
+
+    if (statusCode == 206)
+    {
+        /* Content-Range is "bytes first-last/total", it has to line up with what we have. */
+        unsigned int first = 0, last = 0, total = 0;
+        String contentRange = _imageConnection->httpClient->header("Content-Range");
+        int partLength = _imageConnection->httpClient->getSize();
+
+        if (sscanf(contentRange.c_str(), "bytes %u-%u/%u", &first, &last, &total) != 3
+            || first != offset || total != (unsigned int)_imageLength
+            || (partLength >= 0 && (size_t)partLength != _imageLength - offset))
+        {
+            log_e("Resumed image doesn't match: %s, %d bytes", contentRange.c_str(), partLength);
+            return false;
+        }
+
+        return true;
+    }
+
+    if (statusCode == 200 && _imageConnection->httpClient->getSize() == _imageLength)
+    {
+        /* The server ignored the range, skip what we already have. */
+        if (!scratch || scratchSize == 0)
+            return false;
+
+        WiFiClient &client = _imageConnection->httpClient->getStream();
+        unsigned long lastData = millis();
+
+        while (offset > 0)
+        {
+            int c = client.available() > 0 ? client.read(scratch, min(offset, scratchSize)) : 0;
+            if (c > 0)
+            {
+                offset -= c;
+                lastData = millis();
+                continue;
+            }
+
+            if (!client.connected() || millis() - lastData >= SPOTIFY_TIMEOUT)
+                return false;
+
+            delay(1);
         }
 
-        log_d("Finished getting image");
+        return true;
+    }
+
+    log_e("Could not resume the image: %d", statusCode);
+    return false;
+}
+
+void SpotifyESP::copyImageChunk(const uint8_t *data, size_t offset, size_t length)
+{
+    if (_imageMemoryCopy && offset + length <= (size_t)_imageLength)
+        memcpy(_imageMemoryCopy + offset, data, length);
+}
+
+void SpotifyESP::finishImage(size_t received)
+{
+    bool complete = _imageLength > 0 && received == (size_t)_imageLength;
+
+    if (_imageCacheFile)
+    {
+        if (complete)
+            _imageCache->commit(_imageKey, _imageCacheFile, received);
+        else
+            _imageCache->discard(_imageKey, _imageCacheFile);
+    }
+
+    if (_imageMemoryCopy)
+    {
+        if (complete)
+            _imageMemoryCache->insert(_imageKey, _imageMemoryCopy, received);
+        else
+            _imageMemoryCache->release(_imageMemoryCopy);
+
+        _imageMemoryCopy = nullptr;
     }
+}
 
-    _httpClient->end();
+void SpotifyESP::endImage()
+{
+    endRequest(_imageConnection);
+    _imageFile.close();
+    _imageMemory = nullptr;
+
+    /* Nothing was read, so nothing is complete. */
+    finishImage(0);
+}
 
-    return (_imageLength > 0) ? SpotifyResult::eSuccess : SpotifyResult::eInvalidImage; //Probably could be improved!
+void SpotifyESP::setImageMemoryCache(SpotifyImageMemoryCache *imageMemoryCache)
+{
+    endImage();
+    _imageMemoryCache = imageMemoryCache;
 }
 
 SpotifyResult SpotifyESP::processJsonError(DeserializationError error)
@@ -1150,13 +3499,13 @@ SpotifyResult SpotifyESP::processJsonError(DeserializationError error)
     }
 }
 
-SpotifyResult SpotifyESP::processAuthenticationError()
+SpotifyResult SpotifyESP::processAuthenticationError(SpotifyConnection *connection)
 {
     StaticJsonDocument<48> filter;
     filter["error"] = true;
 
     DynamicJsonDocument doc(1000);
-    DeserializationError error = deserializeJson(doc, _httpClient->getStream(), DeserializationOption::Filter(filter));
+    DeserializationError error = deserializeResponse(doc, connection, &filter);
 
     if (error)
         return processJsonError(error);
@@ -1193,19 +3542,20 @@ SpotifyResult SpotifyESP::processAuthenticationError()
     }
 }
 
-SpotifyResult SpotifyESP::processRegularError(int code)
+SpotifyResult SpotifyESP::processRegularError(int code, SpotifyConnection *connection)
 {
-    if (code < 0) 
+    if (code < 0 || !connection) 
         return SpotifyResult::eRequestFailed;
 
     /* Filter the Spotify error status and message.  */
-    StaticJsonDocument<48> filter;
+    StaticJsonDocument<96> filter;
     filter["error"]["status"] = true;
     filter["error"]["message"] = true;
+    filter["error"]["reason"] = true;
 
     /* Deserialize the error JSON. */
     DynamicJsonDocument doc(512);
-    DeserializationError error = deserializeJson(doc, _httpClient->getStream(), DeserializationOption::Filter(filter));
+    DeserializationError error = deserializeResponse(doc, connection, &filter);
    
     int status = doc["error"]["status"].as<int>();
     const char* message = doc["error"]["message"].as<const char*>();
@@ -1216,6 +3566,14 @@ SpotifyResult SpotifyESP::processRegularError(int code)
 
     /* Print Spotify's message and return error. */
     log_e("Spotify Error! Status: %d, Message: %s", status, message);
+
+    /* Player commands say why, remember it so the next one isn't sent. */
+    const char *reason = doc["error"]["reason"];
+    if (status == 403 && reason && strcmp(reason, "PREMIUM_REQUIRED") == 0)
+    {
+        _product = SpotifyProduct::eFree;
+        return SpotifyResult::ePremiumRequired;
+    }
     switch (status) {
     case 304: return SpotifyResult::eNotModified;
     case 400: return SpotifyResult::eBadRequest;
@@ -10,6 +10,17 @@
 #include "SpotifyBase64.h"
 #include "SpotifyStructs.h"
 #include "SpotifyCert.h"
+#include "SpotifyConnectionPool.h"
+#include "SpotifyBufferedStream.h"
+#include "SpotifyInflateStream.h"
+#include "SpotifyImageCache.h"
+#include "SpotifyImageMemoryCache.h"
+#include "SpotifySearchCache.h"
+#include "SpotifySearchQuery.h"
+#include "SpotifyPlayRequest.h"
+#include "SpotifyDeviceRegistry.h"
+#include "SpotifyCredentialStore.h"
+#include "SpotifyThumbnail.h"
 
 #ifdef SPOTIFY_PRINT_JSON_PARSE
 #include <StreamUtils.h>
@@ -46,7 +57,47 @@ public:
     */
     SpotifyESP(WiFiClientSecure &wifiClient, HTTPClient &httpClient, const char *clientId, const char *clientSecret, const char *refreshToken = "");
 
-   
+// ========================================
+// Connection API
+// ========================================
+
+    /** @brief Adds another client pair for the library to send requests with.
+     * 
+     * Each host (the API, accounts and image servers) gets its own connection
+     * so an image download doesn't have to wait for the API to be polled. By
+     * default the library allocates extra clients itself when the heap 
+     * allows it, use this if you'd rather provide and configure them.
+     * 
+     * @param wifiClient Your secure Wi-Fi client, must outlive this object.
+     * @param httpClient Your HTTP client, must outlive this object.
+     * 
+     * @return True on -- there was room for another connection.
+     */
+    bool addConnection(WiFiClientSecure &wifiClient, HTTPClient &httpClient);
+
+    /** @brief The connections requests are sent on, use it to change the session limits. */
+    SpotifyConnectionPool& getConnectionPool();
+
+    /** @brief Opens the connection to Spotify's API ahead of a command.
+     * 
+     * Call this when a hint fires that the user is about to do something, like
+     * the screen waking up, a touch or a proximity sensor. DNS, TCP and the TLS
+     * handshake happen now, and the access token is refreshed if it's due, so
+     * a command sent shortly after goes out on the already open socket. The
+     * connection is closed again once it has been idle for the timeout.
+     * 
+     * @param[in] idleTimeoutMs optional, How long the connection may sit unused before it is closed.
+     * 
+     * @return True on -- the connection is open and ready.
+     */
+    bool warmConnection(unsigned long idleTimeoutMs = SPOTIFY_WARM_IDLE_TIMEOUT);
+
+    /** @brief Closes warmed connections that have timed out, call this from your loop. */
+    void maintainConnections();
+
+    /** @brief Bytes received and inflated for the endpoints in @ref compressedEndpoints. */
+    SpotifyCompressionStats getCompressionStats();
+
 // ========================================
 // Authentication API
 // ========================================
@@ -188,6 +239,51 @@ public:
      */
     const String& getRefreshToken();
 
+    /** @brief The scopes the current access token was granted.
+     * 
+     * Taken from the token response, so it's only known after the first
+     * refresh. Requests that need a scope which wasn't granted fail with
+     * eMissingScope without being sent.
+     * 
+     * @return The granted scopes, eAll when they aren't known yet.
+     */
+    SpotifyScopeFlags getGrantedScopes();
+
+    /** @brief Saves the tokens to a store whenever they change, and restores them now.
+     * 
+     * The refresh token in the store replaces the one given to the
+     * constructor, it's the newest one Spotify handed out. When the clock has
+     * been set by SNTP and the saved access token hasn't expired, it's used
+     * as is and the first request after a reboot skips the refresh.
+     * 
+     * @code{cpp}
+     * SpotifyNvsCredentialStore credentials;
+     * 
+     * configTime(0, 0, "pool.ntp.org");
+     * spotify.setCredentialStore(&credentials);
+     * @endcode
+     * 
+     * @param[in] credentialStore Where to keep the tokens, must outlive this object. nullptr stops saving them.
+     * 
+     * @return True on -- saved credentials were restored.
+     */
+    bool setCredentialStore(SpotifyCredentialStore *credentialStore);
+
+    /** @brief Gets the user's subscription level, fetching it from /v1/me only the first time.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-current-users-profile
+     * 
+     * Once the product is known, player commands on a free account fail with
+     * ePremiumRequired without being sent. A player command that Spotify
+     * refuses for needing Premium also makes the product known.
+     * 
+     * @param[out] product The user's product, eUnknown when the token lacks user-read-private.
+     * @param[in] refresh optional, Fetch it again even if it's already known.
+     * 
+     * @return True on -- the profile was received, or the product was already known.
+     */
+    SpotifyResult getProduct(SpotifyProduct &product, bool refresh = false);
+
 
 // ========================================
 // User API
@@ -243,6 +339,30 @@ public:
      */
     SpotifyResult getAvailableDevices(SpotifyCallbackOnDevices callback);
 
+    /** @brief Finds one of the user's devices by its name or id.
+     *
+     * Looks in the device registry first, which is filled by @ref getAvailableDevices
+     * and kept current by @ref getPlaybackState. The device list is only
+     * fetched when the device isn't known and the registry is older than
+     * its ttlMs. Names are compared without regard to case.
+     *
+     * Every player command that takes a deviceId also takes a device name,
+     * it's looked up the same way. A device id is sent as it is, those
+     * commands never fetch the device list for one. A name that doesn't
+     * match any device fails the command with eDeviceNotFound, nothing is
+     * sent to Spotify.
+     *
+     * @param[in] nameOrId The name shown in Spotify's apps, or a device id.
+     * @param[out] device optional, Filled with the device that was found.
+     *
+     * @return True on -- the device is known.
+     * @return eDeviceNotFound on -- no device has that name or id.
+     */
+    SpotifyResult findDevice(const char *nameOrId, SpotifyDevice *device = nullptr);
+
+    /** @brief The devices that have been seen, to look them up or change how long the list is trusted. */
+    SpotifyDeviceRegistry& getDeviceRegistry() { return _devices; }
+
     /** @brief Starts or resumes playback on a device.
      * 
      * @url https://developer.spotify.com/documentation/web-api/reference/start-a-users-playback
@@ -298,6 +418,23 @@ public:
      */
     SpotifyResult playAdvanced(char *body, const char *deviceId = "");
 
+    /** @brief Starts playing a context or a list of tracks, see @ref SpotifyPlayRequest.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/start-a-users-playback
+     * 
+     * The body is written straight into the request as it's sent, so the
+     * track list can be as long as Spotify allows. It's checked first, a
+     * request that doesn't make sense isn't sent.
+     * 
+     * @param[in] request What to play.
+     * @param[in] deviceId optional, a device to play on.
+     * 
+     * @return True on -- playback started.
+     * 
+     * @note Requires Spotify premium.
+     */
+    SpotifyResult play(const SpotifyPlayRequest &request, const char *deviceId = "");
+
     /** @brief Sets the volume of a device.
      * 
      * @url https://developer.spotify.com/documentation/web-api/reference/set-volume-for-users-playback
@@ -428,9 +565,9 @@ public:
      * 
      * Transfers playback from one device that may currently be playing audio
      * and can start playing audio on that device too. The device id must be a
-     * valid device id from @ref getAvailableDevices.
+     * valid device id from @ref getAvailableDevices, or a device's name.
      * 
-     * @param[in] deviceId An id of a playback device.
+     * @param[in] deviceId An id or name of a playback device.
      * @param[in] play optional, True for -- plays on the device transferred to.
      * 
      * @return True on -- successfully transferred playback to the device.
@@ -476,7 +613,193 @@ public:
      * @return The http code returned from the get request. 
      * 
      */
-    SpotifyResult searchForSong(String query, int limit, SpotifyCallbackOnSearch searchCallback, SpotifySearchResult* results);
+    SpotifyResult searchForSong(const String &query, int limit, SpotifyCallbackOnSearch searchCallback, SpotifySearchResult* results);
+
+    /** @brief Searches for tracks, albums, artists and playlists in one request.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/search
+     * 
+     * Only the types that have a callback are asked for. Each type's results
+     * are parsed one at a time as they arrive, so a large limit doesn't need
+     * a large buffer. Spotify gives the total after the items, so the count
+     * given to the callbacks is -1. With @ref setSearchCache the results are
+     * kept, and the same search again doesn't touch the network.
+     * 
+     * @param[in] query What to look for as typed, it's URL encoded for you.
+     * @param[in] callbacks Ran for every result of their type. Return false to stop the whole search.
+     * @param[in] limit optional, Max results of each type, up to 50.
+     * 
+     * @return True on -- the results were received.
+     */
+    SpotifyResult search(const char *query, const SpotifySearchCallbacks &callbacks, int limit = 10);
+
+    /** @brief Searches with field filters, see @ref SpotifySearchQuery. 
+     * 
+     * @return eQueryTooLong on -- part of the query didn't fit in its buffer, nothing was sent.
+     */
+    SpotifyResult search(SpotifySearchQuery &query, const SpotifySearchCallbacks &callbacks, int limit = 10);
+
+    /** @brief Sets a cache for the results of @ref search, nullptr to stop caching.
+     * 
+     * @param[in] searchCache The cache to use, must outlive this object.
+     * 
+     */
+    void setSearchCache(SpotifySearchCache *searchCache);
+
+// ========================================
+// Catalog API
+// ========================================
+
+    /** @brief Looks up many tracks with as few requests as possible.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-several-tracks
+     * 
+     * The list is split into requests of 50 tracks, the most Spotify allows,
+     * and each response is parsed one track at a time so the whole batch is
+     * never in memory. Tracks Spotify doesn't know are skipped.
+     * 
+     * @param[in] uris Track URIs ("spotify:track:...") or bare ids.
+     * @param[in] count How many URIs there are.
+     * @param[in] callback Ran for every track, the index is its position in the list. Return false to stop.
+     * @param[in] market optional, An ISO 3166-1 country code to relink tracks for.
+     * 
+     * @return True on -- every batch was received.
+     */
+    SpotifyResult getTracks(const char *const *uris, int count, SpotifyCallbackOnTrack callback, const char *market = "");
+
+    /** @brief Goes through every track of a playlist.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-playlists-tracks
+     * 
+     * Pages are requested one after another and parsed an item at a time, the
+     * next page is fetched in the background while the callback works
+     * through the current one. Memory use depends on the page size, not the
+     * size of the playlist. Removed and local tracks are skipped. The
+     * callback runs on the calling task and may send other requests.
+     * 
+     * @param[in] playlist The playlist's URI or id.
+     * @param[in] callback Ran for every track with its index and the playlist's total, -1 if Spotify didn't send it. Return false to stop.
+     * @param[in] market optional, An ISO 3166-1 country code to relink tracks for.
+     * 
+     * @return True on -- every page was received.
+     */
+    SpotifyResult getPlaylistTracks(const char *playlist, SpotifyCallbackOnTrack callback, const char *market = "");
+
+    /** @brief Gets only the snapshot id of a playlist, it changes whenever the playlist does.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-playlist
+     * 
+     * @param[in] playlist The playlist's URI or id.
+     * @param[out] snapshotId Receives the snapshot id.
+     * @param[in] length Size of snapshotId, @ref SPOTIFY_SNAPSHOT_ID_CHAR_LENGTH is enough.
+     * 
+     * @return True on -- the snapshot id was received.
+     */
+    SpotifyResult getPlaylistSnapshotId(const char *playlist, char *snapshotId, size_t length);
+
+    /** @brief Goes through the tracks saved in the user's library, see @ref getPlaylistTracks. 
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-users-saved-tracks
+     */
+    SpotifyResult getSavedTracks(SpotifyCallbackOnTrack callback, const char *market = "");
+
+    /** @brief Goes through the playlists the user owns or follows, see @ref getPlaylistTracks. 
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-a-list-of-current-users-playlists
+     */
+    SpotifyResult getUserPlaylists(SpotifyCallbackOnPlaylist callback);
+
+    /** @brief Gets the tracks the user played recently, newest first.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-recently-played
+     * 
+     * Pass the newest play time seen so far as after to get only the plays
+     * since, see @ref SpotifyListeningLog to keep them. Spotify doesn't say
+     * how many plays there are up front, so the count given to the callback
+     * is -1.
+     * 
+     * @param[in] callback Ran for every play with when it was played, in Unix milliseconds. Return false to stop.
+     * @param[in] after optional, Only plays after this time in Unix milliseconds, 0 for the latest ones.
+     * @param[in] limit optional, Max plays returned, up to 50.
+     * 
+     * @return True on -- the plays were received.
+     */
+    SpotifyResult getRecentlyPlayed(SpotifyCallbackOnRecentlyPlayed callback, uint64_t after = 0, int limit = SPOTIFY_MAX_RECENTLY_PLAYED);
+
+    /** @brief Gets the user's queue, what's playing and up to 20 items after it.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/get-queue
+     * 
+     * The queue is parsed one item at a time and only a compact record of
+     * each is handed out. Every item is compared by URI with the queue from
+     * the last call, so a display only has to redraw the rows that changed.
+     * The currently playing item comes first with an index of -1, then the
+     * queue from index 0. Rows past @ref SpotifyQueueDiff::count are gone.
+     * Covers of items that weren't queued before are given to
+     * @ref prefetchImage.
+     * 
+     * Stopping early leaves the remembered queue as it was, so the next call
+     * compares against the last complete one.
+     * 
+     * @param[in] callback Ran for every item with how it changed. Return false to stop.
+     * @param[out] diff optional, Receives how many items were added, moved and removed.
+     * 
+     * @return True on -- the queue was received.
+     */
+    SpotifyResult getQueue(SpotifyCallbackOnQueue callback, SpotifyQueueDiff *diff = nullptr);
+
+    /** @brief Forgets the queue remembered by @ref getQueue, the next call reports every item as added. */
+    void resetQueue();
+
+    /** @brief Adds tracks or episodes to the end of the user's queue, in order.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/add-to-queue
+     * 
+     * Spotify takes one item per request. They're sent one after the other
+     * on a single kept alive connection, and each response is read to its
+     * end so the socket stays usable. Unless Spotify closes it, only the
+     * first pays for the TLS handshake. Stops at the first one that fails.
+     * 
+     * @param[in] uris The URIs to queue.
+     * @param[in] count How many there are.
+     * @param[in] deviceId optional, The device whose queue to add to.
+     * @param[out] queued optional, How many were added, also when one failed.
+     * 
+     * @return True on -- every item was queued.
+     * 
+     * @note Requires Spotify premium.
+     */
+    SpotifyResult addToQueue(const char *const *uris, int count, const char *deviceId = "", int *queued = nullptr);
+
+    /** @brief Adds one track or episode to the end of the user's queue. */
+    SpotifyResult addToQueue(const char *uri, const char *deviceId = "") { return addToQueue(&uri, 1, deviceId); }
+
+    /** @brief Saves tracks to the user's library, 50 per request.
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/save-tracks-user
+     * 
+     * The ids of each batch are written straight into the request body, the
+     * list can be any length. Stops at the first batch that fails.
+     * 
+     * @param[in] uris The track URIs or ids.
+     * @param[in] count How many there are.
+     * @param[out] saved optional, How many were saved, also when a batch failed.
+     * 
+     * @return True on -- every track was saved.
+     */
+    SpotifyResult saveTracks(const char *const *uris, int count, int *saved = nullptr);
+
+    /** @brief Removes tracks from the user's library, 50 per request, see @ref saveTracks. 
+     * 
+     * @url https://developer.spotify.com/documentation/web-api/reference/remove-tracks-user
+     */
+    SpotifyResult removeSavedTracks(const char *const *uris, int count, int *removed = nullptr);
+
+    /** @brief Looks up many albums, 20 per request, see @ref getTracks. */
+    SpotifyResult getAlbums(const char *const *uris, int count, SpotifyCallbackOnAlbum callback, const char *market = "");
+
+    /** @brief Looks up many artists, 50 per request, see @ref getTracks. */
+    SpotifyResult getArtists(const char *const *uris, int count, SpotifyCallbackOnArtist callback);
 
 // ========================================
 // Image API
@@ -501,21 +824,126 @@ public:
      */
     SpotifyResult requestImage(char *imageUrl, size_t* length);
 
+    /** @brief Keeps downloaded images on flash so they're only fetched once.
+     * 
+     * When set, @ref requestImage looks the URL up in the cache first and
+     * @ref getImage reads it from flash. Images that aren't cached are saved
+     * while they're downloaded. Pass nullptr to stop using the cache.
+     * 
+     * @param[in] imageCache A cache that has been started with @ref SpotifyImageCache::begin, must outlive this object.
+     * 
+     */
+    void setImageCache(SpotifyImageCache *imageCache);
 
-    /** @brief Pipes the Spotify image data into a stream. 
+    /** @brief Keeps the most recently shown images in RAM.
      * 
+     * Checked before the flash cache, a hit is copied straight out of memory
+     * without any flash or network reads. Images read from flash or the
+     * network are added as they're read. Pass nullptr to stop using it.
      * 
+     * @param[in] imageMemoryCache The cache to use, must outlive this object.
+     * 
+     */
+    void setImageMemoryCache(SpotifyImageMemoryCache *imageMemoryCache);
+
+
+    /** @brief Pipes the Spotify image data into a stream. 
+     * 
+     * The image is downloaded on its own connection, you can keep using the
+     * rest of the API while it is being read.
      * 
      */
     SpotifyResult getImage(Stream* stream);
 
     /** @brief Reads the image data into a buffer.
      *
-     * 
+     * The buffer must hold the length from @ref requestImage. When the server
+     * didn't send a length this fails, use the overload with a capacity.
      *  
      */
     SpotifyResult getImage(uint8_t* buffer);
 
+    /** @brief Reads the image data into a buffer of a known size.
+     * 
+     * Works for images of unknown length too, reading stops when the buffer
+     * is full.
+     * 
+     * @param[out] buffer Where the image is written.
+     * @param[in] capacity The size of the buffer in bytes.
+     * 
+     * @return True on -- the whole image fit in the buffer.
+     */
+    SpotifyResult getImage(uint8_t* buffer, size_t capacity);
+
+    /** @brief Hands the image data to a callback as it arrives.
+     * 
+     * Each chunk is passed on as soon as it has been read, so a decoder like
+     * TJpg_Decoder can work through the JPEG progressively without the whole
+     * image ever being in RAM. Images in the memory cache are passed in one
+     * call straight from the cache. Returning false stops reading, a partly
+     * read image isn't cached.
+     * 
+     * @param[in] callback Receives each chunk, the data is only valid during the call.
+     * 
+     * @return True on -- some of the image was read.
+     */
+    SpotifyResult getImage(SpotifyCallbackOnImageData callback);
+
+    /** @brief Size, time and throughput of the last image read from the network. */
+    SpotifyImageTransferStats getImageTransferStats();
+
+    /** @brief Gets an image decoded and scaled to an RGB565 framebuffer.
+     * 
+     * The first time a cover is shown at a size it's downloaded, decoded and
+     * scaled, then the pixels are stored in the image caches that are set,
+     * on flash as .rgb files apart from the JPEGs. After that it's copied
+     * straight out of the cache with no decode, ready to push to the
+     * display. Pixels are in the CPU's byte order, most SPI TFT libraries
+     * want them swapped (TFT_eSPI's setSwapBytes).
+     * 
+     * @param[in] imageUrl The image url, like one picked by @ref selectImage.
+     * @param[out] framebuffer Receives width * height pixels.
+     * @param[in] width Width of the framebuffer.
+     * @param[in] height Height of the framebuffer.
+     * 
+     * @return True on -- the framebuffer holds the image.
+     */
+    SpotifyResult getImageRGB565(char *imageUrl, uint16_t *framebuffer, int width, int height);
+
+    /** @brief Picks the image closest to the display size.
+     * 
+     * Spotify sends each cover in a few sizes, there's no point downloading
+     * a 640px JPEG for a 128px screen. This picks the smallest image that
+     * still covers the display, or the largest if none of them do.
+     * 
+     * @param[in] images The images from a response, like @ref SpotifyCurrentlyPlaying::albumImages.
+     * @param[in] numImages How many images there are.
+     * 
+     * @return The best image, nullptr when there are none.
+     */
+    const SpotifyImage* selectImage(const SpotifyImage *images, int numImages);
+
+    /** @brief Picks the image closest to the given size, see @ref selectImage. */
+    const SpotifyImage* selectImage(const SpotifyImage *images, int numImages, int width, int height);
+
+    /** @brief Queues an image to be downloaded into the caches in idle time.
+     * 
+     * Use it for the art of upcoming tracks, so the cover is already local
+     * when the track changes. It needs @ref setImageCache or
+     * @ref setImageMemoryCache, images that are already cached are skipped.
+     * 
+     * @param[in] imageUrl The image url, it is copied.
+     * 
+     * @return True on -- the image was queued.
+     */
+    bool prefetchImage(const char *imageUrl);
+
+    /** @brief Downloads one queued image, call this from your loop when nothing else is going on.
+     * 
+     * @return True on -- an image was fetched.
+     */
+    bool prefetchImages();
+
     /** @brief Downloads an image from Spotify's image server and saves it to a buffer. 
      * 
      * Downloads cover art, user images and other Spotify images from the 
@@ -537,7 +965,16 @@ public:
     int playerDetailsBufferSize = 2000;
     int getDevicesBufferSize = 3000;
     int searchDetailsBufferSize = 3000;
+    int catalogItemBufferSize = 2048; /** @brief Parsing buffer for each item of @ref getTracks, @ref getAlbums and @ref getArtists. */
+    int libraryPageSize = SPOTIFY_LIBRARY_PAGE_SIZE; /** @brief Items per page of @ref getPlaylistTracks and the like, two pages are kept in memory. */
+    int jsonStreamBlockSize = SPOTIFY_STREAM_BLOCK_SIZE; /** @brief Bytes read ahead from TLS while parsing JSON, 0 parses straight from the client unbuffered. */
+    size_t imageBlockSize = SPOTIFY_IMAGE_BLOCK_SIZE; /** @brief Bytes of an image read at once, 4-16KB keeps up with the link. */
+    int displayWidth = 0; /** @brief Used by @ref selectImage, 0 picks the smallest image. */
+    int displayHeight = 0;
+    int imageResumeAttempts = SPOTIFY_IMAGE_RESUME_ATTEMPTS; /** @brief Times a dropped image download is resumed with a Range request. */
+    SpotifyEndpointFlags compressedEndpoints = 0; /** @brief Endpoints that ask for gzip responses, see @ref SpotifyEndpointFlagBits. */
     bool autoTokenRefresh = true;
+    bool gateRequests = true; /** @brief Refuse requests the token's scopes or the account's product can't allow, without sending them. */
 
 private:
 
@@ -558,25 +995,103 @@ private:
     const char* _clientSecret;
     unsigned int timeTokenRefreshed;
     unsigned int tokenTimeToLiveMs;
-    WiFiClientSecure* _wifiClient;
-    HTTPClient* _httpClient;
+    SpotifyScopeFlags _grantedScopes; // eAll until a token response says otherwise
+    SpotifyProduct _product;
+    SpotifyConnectionPool _connections;
+    SpotifyConnection* _imageConnection;
     int _imageLength;
+    SpotifyImageCache* _imageCache;
+    fs::File _imageFile; // Open when the requested image came from the cache
+    fs::File _imageCacheFile; // Open while a downloaded image is being saved to the cache
+    uint32_t _imageKey;
+    SpotifyImageMemoryCache* _imageMemoryCache;
+    const uint8_t* _imageMemory; // Set when the requested image came from the memory cache
+    uint8_t* _imageMemoryCopy; // Filled while an image is read, then added to the memory cache
+    SpotifyCompressionStats _compressionStats;
+    portMUX_TYPE _statsLock = portMUX_INITIALIZER_UNLOCKED; // Page prefetching reads responses on another task
+    SpotifyImageTransferStats _imageTransfer;
+    char _prefetch[SPOTIFY_PREFETCH_IMAGES][SPOTIFY_URL_CHAR_LENGTH];
+    int _prefetchCount;
+    char _imageHost[SPOTIFY_HOST_CHAR_LENGTH];
+    char _imagePath[SPOTIFY_URL_CHAR_LENGTH];
+    uint32_t _queue[SPOTIFY_MAX_QUEUE_ITEMS]; // Hashes of the queued URIs from the last getQueue, in order
+    int _queueCount;
+    uint32_t _queueCurrent; // Hash of the URI that was playing
+    SpotifySearchCache* _searchCache;
+    SpotifyDeviceRegistry _devices;
+    SpotifyCredentialStore* _credentialStore;
     
-    // Generic Request Methods
-    int makeGetRequest(const char *command, const char *authorization, const char *accept = "application/json", const char *host = SPOTIFY_HOST);
-    int makeRequestWithBody(const char *type, const char *command, const char *authorization, const char *body = "", const char *contentType = "application/json", const char *host = SPOTIFY_HOST);
-    int makePostRequest(const char *command, const char *authorization, const char *body = "", const char *contentType = "application/json", const char *host = SPOTIFY_HOST);
-    int makePutRequest(const char *command, const char *authorization, const char *body = "", const char *contentType = "application/json", const char *host = SPOTIFY_HOST);
+    // Generic Request Methods, the connection used is returned through the first parameter
+    int makeGetRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *accept = "application/json", const char *host = SPOTIFY_HOST, bool compressed = false, const char *range = nullptr);
+    bool beginRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *contentType, const char *host, bool &reused);
+    int makeRequestWithBody(SpotifyConnection *&connection, const char *type, const char *command, const char *authorization, const char *body = "", const char *contentType = "application/json", const char *host = SPOTIFY_HOST);
+    int makeRequestWithBody(SpotifyConnection *&connection, const char *type, const char *command, const char *authorization, const SpotifyRequestBody &body, const char *host = SPOTIFY_HOST);
+    int makePostRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *body = "", const char *contentType = "application/json", const char *host = SPOTIFY_HOST);
+    int makePutRequest(SpotifyConnection *&connection, const char *command, const char *authorization, const char *body = "", const char *contentType = "application/json", const char *host = SPOTIFY_HOST);
+    void addCompressionStats(const SpotifyInflateStream &inflated);
+    void drainResponse(SpotifyConnection *connection, size_t received); // Skips the rest of a short body so a kept alive socket stays usable
+    void endRequest(SpotifyConnection *&connection);
+    SpotifyResult sendPlayerBody(const char *type, const char *endpoint, const char *deviceId, const SpotifyRequestBody &body);
+    SpotifyResult writeLibraryTracks(const char *type, const char *const *uris, int count, int *written);
+    void saveCredentials(int tokenTtl);
+    SpotifyResult checkAccess(SpotifyScopeFlags anyOf, bool premium = false); // Fails when none of the scopes were granted, or Premium is needed and missing
+    static SpotifyScopeFlags parseScopes(const char *scopes);
+    const SpotifyDevice* lookupDevice(const char *nameOrId);
+    const char* resolveDeviceId(const char *deviceId); // Ids are passed through as they are, a device name becomes its id, nullptr when no device has that name
+
+    // Parses a response body through a read-ahead buffer, the filter is optional
+    DeserializationError deserializeResponse(JsonDocument &doc, SpotifyConnection *connection, const JsonDocument *filter = nullptr);
+    bool wantsCompression(SpotifyEndpointFlagBits endpoint);
+
+    // Parses the elements of a response's array one at a time, so only one is ever in memory
+    SpotifyResult deserializeResponseArray(SpotifyConnection *connection, const char *key, const JsonDocument &filter, const std::function<bool(JsonVariantConst element)> &callback, int *total = nullptr);
+    SpotifyResult readResponse(SpotifyConnection *connection, const std::function<SpotifyResult(Stream &source)> &reader);
+    SpotifyResult readJsonArray(Stream &source, const char *key, const JsonDocument &filter, const std::function<bool(JsonVariantConst element)> &callback, int *total = nullptr);
+    SpotifyResult replaySearch(const uint8_t *records, size_t length, const SpotifySearchCallbacks &callbacks);
+    SpotifyResult getSeveral(const char *endpoint, const char *key, const char *const *uris, int count, int batchSize, const char *market, const JsonDocument &filter, const std::function<bool(JsonVariantConst item, int index)> &callback);
+
+    // Follows a paging object's offsets, parsing items into pages and prefetching the next one
+    using SpotifyParseItem = std::function<bool(JsonVariantConst element, void *item)>;
+    using SpotifyDeliverItem = std::function<bool(const void *item, int index, int total)>;
+    SpotifyResult getPaged(const String &endpoint, size_t itemSize, int pageSize, const JsonDocument &filter, const SpotifyParseItem &parse, const SpotifyDeliverItem &deliver);
+    SpotifyResult fetchPage(const String &endpoint, int offset, int limit, uint8_t *items, size_t itemSize, const JsonDocument &filter, const SpotifyParseItem &parse, const char *authorization, int &elements, int &stored, int &total);
+    static void pageFetchTask(void *parameter);
+
+    static bool seekJsonKey(Stream &stream, const char *key);
+    static bool seekJsonArray(Stream &stream, const char *key);
+    static int readJsonToken(Stream &stream);
+    static bool skipJsonObject(Stream &stream);
+    static const char* idFromUri(const char *uri);
+    static void trackFilter(JsonObject filter);
+    static void albumFilter(JsonObject filter);
+    static void playlistFilter(JsonObject filter);
+    static void parseArtists(JsonVariantConst artists, SpotifyArtist *result, int &numArtists);
+    static void parseImages(JsonVariantConst images, SpotifyImage *result, int &numImages);
+    static void parseTrack(JsonVariantConst track, SpotifyTrack &result);
+    static void parseAlbum(JsonVariantConst album, SpotifyAlbum &result);
+    static void parsePlaylist(JsonVariantConst playlist, SpotifyPlaylist &result);
+    static bool deliverSearchItem(SpotifySearchTypeFlagBits type, JsonVariantConst item, int index, const SpotifySearchCallbacks &callbacks);
+    void parseQueueItem(JsonVariantConst item, SpotifyQueueItem &result);
+    static uint64_t parseTimestamp(const char *timestamp);
+
+    // Reads the requested image from memory, flash or the network into a buffer or a sink
+    SpotifyResult readImage(uint8_t *buffer, size_t capacity, const SpotifyCallbackOnImageData &sink);
+    bool resumeImage(size_t offset, uint8_t *scratch, size_t scratchSize);
+    void storeThumbnail(uint32_t key, const uint16_t *framebuffer, size_t frameSize, bool toFlash);
+    void copyImageChunk(const uint8_t *data, size_t offset, size_t length);
+    void finishImage(size_t received);
+    void endImage();
 
     SpotifyResult processJsonError(DeserializationError error);
-    SpotifyResult processAuthenticationError();
-    SpotifyResult processRegularError(int code);
+    SpotifyResult processAuthenticationError(SpotifyConnection *connection);
+    SpotifyResult processRegularError(int code, SpotifyConnection *connection);
 
 
     const char *requestAccessTokensBody = R"(grant_type=authorization_code&code=%s&redirect_uri=%s&client_id=%s&client_secret=%s)";
     const char *requestAccessTokensBodyPKCE = R"(client_id=%s&grant_type=authorization_code&redirect_uri=%s&code=%s&code_verifier=%s)";
     const char *refreshAccessTokensBody = R"(grant_type=refresh_token&refresh_token=%s&client_id=%s&client_secret=%s)";
     const char *refreshAccessTokensBodyPKCE = R"(grant_type=refresh_token&refresh_token=%s&client_id=%s)";
+    const char *imageAcceptHeader = "text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8";
 
 };
 
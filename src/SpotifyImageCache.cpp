@@ -0,0 +1,358 @@
+#include "SpotifyImageCache.h"
+
+#define SPOTIFY_IMAGE_CACHE_MAGIC 0x32495053 // "SPI2", entries gained a format
+
+/* Written at the start of the index file, followed by the entries. */
+struct SpotifyImageCacheHeader {
+    uint32_t magic;
+    uint32_t clock;
+    uint32_t count;
+};
+
+SpotifyImageCache::SpotifyImageCache(fs::FS &fs, size_t budgetBytes, const char *directory)
+    : _fs(fs)
+    , _budget(budgetBytes)
+    , _directory(directory)
+    , _entries()
+    , _count(0)
+    , _clock(0)
+    , _dirty(false)
+    , _hits(0)
+    , _misses(0)
+    , _bytesSaved(0)
+{
+}
+
+bool SpotifyImageCache::begin()
+{
+    _count = 0;
+    _clock = 0;
+
+    /* SPIFFS has no directories and will just say no, that's fine. */
+    _fs.mkdir(_directory);
+
+    char indexPath[48];
+    snprintf(indexPath, sizeof(indexPath), "%s/index.bin", _directory);
+
+    fs::File index = _fs.open(indexPath, FILE_READ);
+    if (!index)
+    {
+        removeUnindexed();
+        return saveIndex();
+    }
+
+    SpotifyImageCacheHeader header;
+    bool valid = index.read((uint8_t*)&header, sizeof(header)) == sizeof(header)
+              && header.magic == SPOTIFY_IMAGE_CACHE_MAGIC
+              && header.count <= SPOTIFY_IMAGE_CACHE_ENTRIES;
+
+    if (valid)
+    {
+        size_t length = header.count * sizeof(SpotifyImageCacheEntry);
+        valid = index.read((uint8_t*)_entries, length) == length;
+    }
+
+    index.close();
+
+    if (!valid)
+    {
+        /* Nothing is indexed, so every image on flash goes. */
+        log_w("Image cache index is corrupt, starting over");
+        _count = 0;
+        removeUnindexed();
+        return saveIndex();
+    }
+
+    _clock = header.clock;
+
+    /* Drop entries whose file went missing, a power cut mid write can do that. */
+    char imagePath[48];
+    for (uint32_t i = 0; i < header.count; i++)
+    {
+        path(imagePath, sizeof(imagePath), _entries[i].key, _entries[i].format);
+        if (_fs.exists(imagePath))
+            _entries[_count++] = _entries[i];
+        else
+            _dirty = true;
+    }
+
+    /* And remove files the index doesn't know, from a power cut between the rename and the index save. */
+    removeUnindexed();
+
+    log_d("Image cache has %d images", _count);
+
+    return _dirty ? saveIndex() : true;
+}
+
+uint32_t SpotifyImageCache::hash(const char *url)
+{
+    uint32_t hash = 2166136261u;
+    while (*url)
+    {
+        hash ^= (uint8_t)*url++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+bool SpotifyImageCache::contains(uint32_t key, SpotifyImageFormat format)
+{
+    return find(key, format) >= 0;
+}
+
+fs::File SpotifyImageCache::open(uint32_t key, size_t *length, SpotifyImageFormat format)
+{
+    int index = find(key, format);
+    if (index < 0)
+    {
+        _misses++;
+        return fs::File();
+    }
+
+    char imagePath[48];
+    path(imagePath, sizeof(imagePath), key, format);
+
+    fs::File file = _fs.open(imagePath, FILE_READ);
+    if (!file)
+    {
+        /* Someone removed it behind our back. */
+        _misses++;
+        _entries[index] = _entries[--_count];
+        _dirty = true;
+        return file;
+    }
+
+    _hits++;
+    _bytesSaved += _entries[index].size;
+    _entries[index].lastUsed = ++_clock;
+    _dirty = true;
+
+    if (length)
+        *length = _entries[index].size;
+
+    return file;
+}
+
+fs::File SpotifyImageCache::create(uint32_t key, SpotifyImageFormat format)
+{
+    char temporaryPath[48];
+    path(temporaryPath, sizeof(temporaryPath), key, format, true);
+    return _fs.open(temporaryPath, FILE_WRITE);
+}
+
+bool SpotifyImageCache::commit(uint32_t key, fs::File &file, size_t size, SpotifyImageFormat format)
+{
+    file.close();
+
+    char temporaryPath[48];
+    char imagePath[48];
+    path(temporaryPath, sizeof(temporaryPath), key, format, true);
+    path(imagePath, sizeof(imagePath), key, format);
+
+    if (size == 0 || size > _budget)
+    {
+        _fs.remove(temporaryPath);
+        return false;
+    }
+
+    /* Replace an older copy of the same image. */
+    int existing = find(key, format);
+    if (existing >= 0)
+        evict(existing);
+
+    /* Make room by dropping the least recently used images. */
+    size_t used = 0;
+    for (int i = 0; i < _count; i++)
+        used += _entries[i].size;
+
+    while (_count > 0 && (_count >= SPOTIFY_IMAGE_CACHE_ENTRIES || used + size > _budget))
+    {
+        int oldest = 0;
+        for (int i = 1; i < _count; i++)
+            if (_entries[i].lastUsed < _entries[oldest].lastUsed)
+                oldest = i;
+
+        used -= _entries[oldest].size;
+        evict(oldest);
+    }
+
+    if (!_fs.rename(temporaryPath, imagePath))
+    {
+        log_e("Could not move %s into the image cache", temporaryPath);
+        _fs.remove(temporaryPath);
+        return false;
+    }
+
+    SpotifyImageCacheEntry &entry = _entries[_count++];
+    entry.key = key;
+    entry.size = size;
+    entry.lastUsed = ++_clock;
+    entry.format = format;
+
+    return saveIndex();
+}
+
+void SpotifyImageCache::discard(uint32_t key, fs::File &file, SpotifyImageFormat format)
+{
+    file.close();
+
+    char temporaryPath[48];
+    path(temporaryPath, sizeof(temporaryPath), key, format, true);
+    _fs.remove(temporaryPath);
+}
+
+void SpotifyImageCache::clear()
+{
+    char imagePath[48];
+    for (int i = 0; i < _count; i++)
+    {
+        path(imagePath, sizeof(imagePath), _entries[i].key, _entries[i].format);
+        _fs.remove(imagePath);
+    }
+
+    _count = 0;
+    _clock = 0;
+    removeUnindexed();
+    saveIndex();
+}
+
+void SpotifyImageCache::sync()
+{
+    if (_dirty)
+        saveIndex();
+}
+
+SpotifyImageCacheStats SpotifyImageCache::getStats()
+{
+    SpotifyImageCacheStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.bytesSaved = _bytesSaved;
+    stats.bytesUsed = 0;
+    stats.entries = _count;
+
+    for (int i = 0; i < _count; i++)
+        stats.bytesUsed += _entries[i].size;
+
+    return stats;
+}
+
+float SpotifyImageCache::hitRatio()
+{
+    uint32_t total = _hits + _misses;
+    return total ? (float)_hits / total : 0.0f;
+}
+
+int SpotifyImageCache::find(uint32_t key, SpotifyImageFormat format)
+{
+    for (int i = 0; i < _count; i++)
+        if (_entries[i].key == key && _entries[i].format == format)
+            return i;
+
+    return -1;
+}
+
+void SpotifyImageCache::evict(int index)
+{
+    char imagePath[48];
+    path(imagePath, sizeof(imagePath), _entries[index].key, _entries[index].format);
+    _fs.remove(imagePath);
+
+    log_d("Evicted %s from the image cache", imagePath);
+
+    _entries[index] = _entries[--_count];
+    _dirty = true;
+}
+
+bool SpotifyImageCache::saveIndex()
+{
+    char indexPath[48];
+    snprintf(indexPath, sizeof(indexPath), "%s/index.bin", _directory);
+
+    fs::File index = _fs.open(indexPath, FILE_WRITE);
+    if (!index)
+    {
+        log_e("Could not write the image cache index");
+        return false;
+    }
+
+    SpotifyImageCacheHeader header;
+    header.magic = SPOTIFY_IMAGE_CACHE_MAGIC;
+    header.clock = _clock;
+    header.count = _count;
+
+    size_t length = _count * sizeof(SpotifyImageCacheEntry);
+    bool written = index.write((const uint8_t*)&header, sizeof(header)) == sizeof(header)
+                && index.write((const uint8_t*)_entries, length) == length;
+
+    index.close();
+    _dirty = !written;
+    return written;
+}
+
+void SpotifyImageCache::removeUnindexed()
+{
+    /* Removing files while listing them can skip some, so list a handful, remove them and list again. */
+    while (true)
+    {
+        char stale[8][48];
+        int count = 0;
+
+        fs::File directory = _fs.open(_directory);
+        if (!directory || !directory.isDirectory())
+            return;
+
+        for (fs::File file = directory.openNextFile(); file && count < 8; file = directory.openNextFile())
+        {
+            /* Older cores give the whole path as the name. */
+            const char *name = strrchr(file.name(), '/');
+            name = name ? name + 1 : file.name();
+
+            if (!file.isDirectory() && isStale(name))
+                snprintf(stale[count++], sizeof(stale[0]), "%s/%s", _directory, name);
+
+            file.close();
+        }
+
+        directory.close();
+
+        for (int i = 0; i < count; i++)
+        {
+            log_d("Removing %s, the image cache index doesn't know it", stale[i]);
+            _fs.remove(stale[i]);
+        }
+
+        if (count < 8)
+            return;
+    }
+}
+
+bool SpotifyImageCache::isStale(const char *name)
+{
+    /* Only files named like ours are touched, "<key>.<extension>". */
+    char *end;
+    uint32_t key = strtoul(name, &end, 16);
+    if (end != name + 8 || *end != '.')
+        return false;
+
+    /* A temporary file is left over from a download that never finished. */
+    if (strcmp(strrchr(end, '.'), ".tmp") == 0)
+        return true;
+
+    if (strcmp(end + 1, "jpg") == 0)
+        return find(key, SpotifyImageFormat::eJpeg) < 0;
+
+    if (strcmp(end + 1, "rgb") == 0)
+        return find(key, SpotifyImageFormat::eRgb565) < 0;
+
+    /* Nothing we write any more. */
+    return true;
+}
+
+void SpotifyImageCache::path(char *buffer, size_t length, uint32_t key, SpotifyImageFormat format, bool temporary)
+{
+    /* The format stays in a temporary name too, so two downloads with the same key don't share a file. */
+    const char *extension = (format == SpotifyImageFormat::eRgb565) ? "rgb" : "jpg";
+    snprintf(buffer, length, "%s/%08x.%s%s", _directory, key, extension, temporary ? ".tmp" : "");
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "SpotifyConfig.h"
+
+/** @brief What a cached image holds, each is stored under its own extension. */
+enum class SpotifyImageFormat : uint8_t {
+    eJpeg, // The image as Spotify serves it, .jpg
+    eRgb565 // A thumbnail decoded by SpotifyThumbnail, .rgb
+};
+
+/** @brief One cached image in the on-flash index. */
+struct SpotifyImageCacheEntry {
+    uint32_t key; /** @brief Hash of the image URL, also the file name. */
+    uint32_t size; /** @brief Size of the image in bytes. */
+    uint32_t lastUsed; /** @brief Value of the cache's use counter when last read, for LRU eviction. */
+    SpotifyImageFormat format; /** @brief Images of different formats never match each other, even with the same key. */
+};
+
+/** @brief How well the image cache is doing. */
+struct SpotifyImageCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t bytesSaved; /** @brief Bytes that didn't have to be downloaded. */
+    uint32_t bytesUsed; /** @brief Bytes currently stored. */
+    int entries;
+};
+
+/** @brief Keeps downloaded album art on flash.
+ *
+ * Images are stored as files named after a hash of their URL, in LittleFS,
+ * SPIFFS or any other Arduino file system. JPEGs end in .jpg and decoded
+ * thumbnails in .rgb, an image is only found in the format it was stored
+ * as. A compact index of every file, its size and when it was last used
+ * lives next to them. When a new image doesn't fit in the byte budget, the
+ * least recently used ones are removed.
+ *
+ * Give it to @ref SpotifyESP::setImageCache and @ref SpotifyESP::requestImage
+ * will read cached images straight from flash without touching the network.
+ *
+ * @code{cpp}
+ * SpotifyImageCache imageCache(LittleFS);
+ *
+ * LittleFS.begin(true);
+ * imageCache.begin();
+ * spotify.setImageCache(&imageCache);
+ * @endcode
+ *
+ */
+class SpotifyImageCache {
+public:
+    SpotifyImageCache(fs::FS &fs, size_t budgetBytes = SPOTIFY_IMAGE_CACHE_BUDGET, const char *directory = SPOTIFY_IMAGE_CACHE_DIRECTORY);
+
+    /** @brief Loads the index from flash, call after mounting the file system.
+     *
+     * @return True on -- the index was loaded or a new one was created.
+     */
+    bool begin();
+
+    /** @brief FNV-1a hash of an image URL, used as its key. */
+    static uint32_t hash(const char *url);
+
+    /** @brief Whether an image is in the cache, doesn't count as a use. */
+    bool contains(uint32_t key, SpotifyImageFormat format = SpotifyImageFormat::eJpeg);
+
+    /** @brief Opens a cached image for reading.
+     *
+     * @param[in] key The hash of the image URL.
+     * @param[out] length Size of the image in bytes.
+     * @param[in] format What kind of image is wanted.
+     *
+     * @return An invalid file on -- the image isn't cached.
+     */
+    fs::File open(uint32_t key, size_t *length, SpotifyImageFormat format = SpotifyImageFormat::eJpeg);
+
+    /** @brief Opens a temporary file to download an image into. */
+    fs::File create(uint32_t key, SpotifyImageFormat format = SpotifyImageFormat::eJpeg);
+
+    /** @brief Adds a downloaded image to the cache, evicting old ones to make room.
+     *
+     * @param[in] key The hash of the image URL.
+     * @param[in] file The file from @ref create, it will be closed.
+     * @param[in] size The number of bytes written.
+     * @param[in] format The format it was created with.
+     *
+     * @return True on -- the image was stored.
+     */
+    bool commit(uint32_t key, fs::File &file, size_t size, SpotifyImageFormat format = SpotifyImageFormat::eJpeg);
+
+    /** @brief Throws away a download that didn't finish. */
+    void discard(uint32_t key, fs::File &file, SpotifyImageFormat format = SpotifyImageFormat::eJpeg);
+
+    /** @brief Removes every cached image. */
+    void clear();
+
+    /** @brief Writes the LRU order out to flash, it is otherwise only written when images are added. */
+    void sync();
+
+    SpotifyImageCacheStats getStats();
+
+    /** @brief Fraction of requests that were served from flash, from 0 to 1. */
+    float hitRatio();
+
+private:
+    int find(uint32_t key, SpotifyImageFormat format);
+    void evict(int index);
+    bool saveIndex();
+    void removeUnindexed(); // Deletes files on flash the index doesn't list, and temporary ones
+    bool isStale(const char *name);
+    void path(char *buffer, size_t length, uint32_t key, SpotifyImageFormat format, bool temporary = false);
+
+    fs::FS &_fs;
+    size_t _budget;
+    const char *_directory;
+
+    SpotifyImageCacheEntry _entries[SPOTIFY_IMAGE_CACHE_ENTRIES];
+    int _count;
+    uint32_t _clock;
+    bool _dirty;
+
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _bytesSaved;
+};
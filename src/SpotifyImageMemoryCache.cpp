@@ -0,0 +1,187 @@
+#include <esp_heap_caps.h>
+
+#include "SpotifyImageMemoryCache.h"
+
+static_assert((SPOTIFY_IMAGE_MEMORY_BUCKETS & (SPOTIFY_IMAGE_MEMORY_BUCKETS - 1)) == 0, "SPOTIFY_IMAGE_MEMORY_BUCKETS must be a power of two");
+static_assert(SPOTIFY_IMAGE_MEMORY_ENTRIES < 128, "Entries are indexed with int8_t");
+
+SpotifyImageMemoryCache::SpotifyImageMemoryCache(size_t budgetBytes)
+    : _budget(budgetBytes)
+    , _used(0)
+    , _entries()
+    , _newest(-1)
+    , _oldest(-1)
+    , _count(0)
+    , _hits(0)
+    , _misses(0)
+    , _bytesSaved(0)
+{
+    memset(_buckets, -1, sizeof(_buckets));
+}
+
+SpotifyImageMemoryCache::~SpotifyImageMemoryCache()
+{
+    clear();
+}
+
+const uint8_t* SpotifyImageMemoryCache::find(uint32_t key, size_t *length)
+{
+    int index = lookup(key);
+    if (index < 0)
+    {
+        _misses++;
+        return nullptr;
+    }
+
+    _hits++;
+    _bytesSaved += _entries[index].size;
+
+    unlinkUsage(index);
+    linkNewest(index);
+
+    if (length)
+        *length = _entries[index].size;
+
+    return _entries[index].data;
+}
+
+uint8_t* SpotifyImageMemoryCache::reserve(size_t length)
+{
+    if (length == 0 || length > _budget)
+        return nullptr;
+
+    while (_oldest >= 0 && (_count >= SPOTIFY_IMAGE_MEMORY_ENTRIES || _used + length > _budget))
+        evictOldest();
+
+    uint8_t *data = (uint8_t*)heap_caps_malloc(length, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!data)
+        data = (uint8_t*)malloc(length);
+
+    if (!data)
+        log_w("Not enough memory to keep a %d byte image", length);
+
+    return data;
+}
+
+void SpotifyImageMemoryCache::insert(uint32_t key, uint8_t *data, size_t length)
+{
+    int existing = lookup(key);
+    if (existing >= 0)
+        remove(existing);
+
+    /* reserve() made room, unless someone skipped it. */
+    while (_oldest >= 0 && (_count >= SPOTIFY_IMAGE_MEMORY_ENTRIES || _used + length > _budget))
+        evictOldest();
+
+    int index = 0;
+    while (_entries[index].data)
+        index++;
+
+    SpotifyImageMemoryEntry &entry = _entries[index];
+    entry.key = key;
+    entry.data = data;
+    entry.size = length;
+
+    int bucket = key & (SPOTIFY_IMAGE_MEMORY_BUCKETS - 1);
+    entry.nextInBucket = _buckets[bucket];
+    _buckets[bucket] = index;
+
+    linkNewest(index);
+
+    _used += length;
+    _count++;
+}
+
+void SpotifyImageMemoryCache::release(uint8_t *data)
+{
+    free(data);
+}
+
+void SpotifyImageMemoryCache::clear()
+{
+    while (_oldest >= 0)
+        evictOldest();
+}
+
+SpotifyImageCacheStats SpotifyImageMemoryCache::getStats()
+{
+    SpotifyImageCacheStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.bytesSaved = _bytesSaved;
+    stats.bytesUsed = _used;
+    stats.entries = _count;
+    return stats;
+}
+
+float SpotifyImageMemoryCache::hitRatio()
+{
+    uint32_t total = _hits + _misses;
+    return total ? (float)_hits / total : 0.0f;
+}
+
+int SpotifyImageMemoryCache::lookup(uint32_t key)
+{
+    int index = _buckets[key & (SPOTIFY_IMAGE_MEMORY_BUCKETS - 1)];
+    while (index >= 0 && _entries[index].key != key)
+        index = _entries[index].nextInBucket;
+
+    return index;
+}
+
+void SpotifyImageMemoryCache::remove(int index)
+{
+    SpotifyImageMemoryEntry &entry = _entries[index];
+
+    /* Unlink it from its bucket. */
+    int8_t *link = &_buckets[entry.key & (SPOTIFY_IMAGE_MEMORY_BUCKETS - 1)];
+    while (*link != index)
+        link = &_entries[*link].nextInBucket;
+    *link = entry.nextInBucket;
+
+    unlinkUsage(index);
+
+    free(entry.data);
+    _used -= entry.size;
+    _count--;
+
+    entry = {};
+}
+
+void SpotifyImageMemoryCache::evictOldest()
+{
+    log_d("Dropping image %08x from memory", _entries[_oldest].key);
+    remove(_oldest);
+}
+
+void SpotifyImageMemoryCache::unlinkUsage(int index)
+{
+    SpotifyImageMemoryEntry &entry = _entries[index];
+
+    if (entry.newer >= 0)
+        _entries[entry.newer].older = entry.older;
+    else
+        _newest = entry.older;
+
+    if (entry.older >= 0)
+        _entries[entry.older].newer = entry.newer;
+    else
+        _oldest = entry.newer;
+
+    entry.newer = -1;
+    entry.older = -1;
+}
+
+void SpotifyImageMemoryCache::linkNewest(int index)
+{
+    SpotifyImageMemoryEntry &entry = _entries[index];
+    entry.newer = -1;
+    entry.older = _newest;
+
+    if (_newest >= 0)
+        _entries[_newest].newer = index;
+    else
+        _oldest = index;
+
+    _newest = index;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyConfig.h"
+#include "SpotifyImageCache.h"
+
+/** @brief One image held in RAM. */
+struct SpotifyImageMemoryEntry {
+    uint32_t key; /** @brief Hash of the image URL, see @ref SpotifyImageCache::hash. */
+    uint8_t *data;
+    size_t size;
+    int8_t newer; /** @brief Next entry towards the most recently used, -1 at the end. */
+    int8_t older; /** @brief Next entry towards the least recently used, -1 at the end. */
+    int8_t nextInBucket;
+};
+
+/** @brief Keeps the last few images in RAM.
+ *
+ * Flipping back to a track that was just shown shouldn't cost a download, or
+ * even a flash read. The bytes of the most recently shown images are kept in
+ * memory, in PSRAM when the board has it, up to a byte budget. Looking an
+ * image up is a hash of its URL and a bucket walk, the least recently used
+ * image is dropped when a new one doesn't fit.
+ *
+ * Give it to @ref SpotifyESP::setImageMemoryCache, it can be used alone or in
+ * front of a @ref SpotifyImageCache on flash.
+ *
+ */
+class SpotifyImageMemoryCache {
+public:
+    SpotifyImageMemoryCache(size_t budgetBytes = SPOTIFY_IMAGE_MEMORY_BUDGET);
+    ~SpotifyImageMemoryCache();
+
+    SpotifyImageMemoryCache(const SpotifyImageMemoryCache&) = delete;
+    SpotifyImageMemoryCache& operator=(const SpotifyImageMemoryCache&) = delete;
+
+    /** @brief Looks an image up and marks it as used.
+     *
+     * @param[in] key The hash of the image URL.
+     * @param[out] length Size of the image in bytes.
+     *
+     * @return The image bytes, owned by the cache, or nullptr on -- the image isn't cached.
+     */
+    const uint8_t* find(uint32_t key, size_t *length);
+
+    /** @brief Whether an image is in the cache, doesn't count as a use. */
+    bool contains(uint32_t key) { return lookup(key) >= 0; }
+
+    /** @brief Allocates room for an image, evicting old ones to stay in budget.
+     *
+     * Fill the buffer then hand it back with @ref insert, or @ref release it
+     * if the image didn't arrive.
+     *
+     * @return nullptr on -- the image is larger than the budget or there is no memory.
+     */
+    uint8_t* reserve(size_t length);
+
+    /** @brief Adds a buffer from @ref reserve to the cache, which now owns it. */
+    void insert(uint32_t key, uint8_t *data, size_t length);
+
+    /** @brief Frees a buffer from @ref reserve that won't be inserted. */
+    void release(uint8_t *data);
+
+    /** @brief Frees every cached image. */
+    void clear();
+
+    SpotifyImageCacheStats getStats();
+
+    /** @brief Fraction of lookups that were served from RAM, from 0 to 1. */
+    float hitRatio();
+
+private:
+    int lookup(uint32_t key);
+    void remove(int index);
+    void evictOldest();
+    void unlinkUsage(int index);
+    void linkNewest(int index);
+
+    size_t _budget;
+    size_t _used;
+
+    SpotifyImageMemoryEntry _entries[SPOTIFY_IMAGE_MEMORY_ENTRIES];
+    int8_t _buckets[SPOTIFY_IMAGE_MEMORY_BUCKETS];
+    int8_t _newest;
+    int8_t _oldest;
+    int _count;
+
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _bytesSaved;
+};
@@ -0,0 +1,199 @@
+#include "SpotifyImagePipeline.h"
+#include "SpotifyESP.h"
+
+SpotifyImagePipeline::SpotifyImagePipeline(SpotifyCallbackOnImageData decoder, int slots, size_t slotSize)
+    : _decoder(decoder)
+    , _slots(slots)
+    , _slotSize(slotSize)
+    , _memory((uint8_t*)malloc(slots * slotSize))
+    , _lengths((size_t*)malloc(slots * sizeof(size_t)))
+    , _head(0)
+    , _tail(0)
+    , _finished(false)
+    , _cancelled(false)
+    , _decoderDone(false)
+    , _filling(0)
+    , _producerTask(nullptr)
+    , _decoderTask(nullptr)
+    , _startMs(0)
+    , _stats()
+{
+    if (!_memory || !_lengths)
+    {
+        log_e("Could not allocate a %d byte image pipeline", slots * slotSize);
+        free(_memory);
+        free(_lengths);
+        _memory = nullptr;
+        _lengths = nullptr;
+    }
+}
+
+SpotifyImagePipeline::~SpotifyImagePipeline()
+{
+    free(_memory);
+    free(_lengths);
+}
+
+SpotifyResult SpotifyImagePipeline::run(SpotifyESP &spotify)
+{
+    /* With one core the decoder would only take turns with the download, and pay for the ring on top. */
+    if (!valid() || (decoderCore < 0 && portNUM_PROCESSORS == 1))
+        return decodeInline(spotify);
+
+    _head = 0;
+    _tail = 0;
+    _finished = false;
+    _cancelled = false;
+    _decoderDone = false;
+    _filling = 0;
+    _stats = {};
+    _startMs = millis();
+
+    _producerTask = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    int core = decoderCore;
+    if (core < 0)
+        core = (portNUM_PROCESSORS > 1) ? 1 - xPortGetCoreID() : 0;
+
+    if (xTaskCreatePinnedToCore(decoderTask, "spotifyImage", decoderStackSize, this, decoderPriority, &_decoderTask, core) != pdPASS)
+    {
+        log_w("Could not start the decoder task, decoding as the image arrives");
+        return decodeInline(spotify);
+    }
+
+    SpotifyResult result = spotify.getImage([this](const uint8_t *data, size_t length) {
+        return push(data, length);
+    });
+
+    /* The last block is usually only partly full. */
+    if (_filling > 0 && !_cancelled)
+        publish();
+
+    _stats.downloadMs = millis() - _startMs;
+    _finished.store(true, std::memory_order_release);
+    xTaskNotifyGive(_decoderTask);
+
+    while (!_decoderDone.load(std::memory_order_acquire))
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+
+    /* The decoder parks itself once it's done, so its handle is still ours to delete. */
+    vTaskDelete(_decoderTask);
+    _decoderTask = nullptr;
+
+    _stats.totalMs = millis() - _startMs;
+
+    log_d("Pipelined %d bytes: first block %dms, download %dms, decode %dms, total %dms",
+        _stats.bytes, _stats.firstBlockMs, _stats.downloadMs, _stats.decodeMs, _stats.totalMs);
+
+    return result;
+}
+
+SpotifyResult SpotifyImagePipeline::decodeInline(SpotifyESP &spotify)
+{
+    _stats = {};
+    _startMs = millis();
+
+    SpotifyResult result = spotify.getImage([this](const uint8_t *data, size_t length) {
+        unsigned long start = millis();
+        if (_stats.bytes == 0)
+            _stats.firstBlockMs = start - _startMs;
+
+        _stats.bytes += length;
+        bool more = _decoder(data, length);
+        _stats.decodeMs += millis() - start;
+        return more;
+    });
+
+    _stats.totalMs = millis() - _startMs;
+    _stats.downloadMs = _stats.totalMs - _stats.decodeMs;
+    return result;
+}
+
+bool SpotifyImagePipeline::push(const uint8_t *data, size_t length)
+{
+    _stats.bytes += length;
+
+    while (length > 0)
+    {
+        /* Wait for the decoder to free a slot. */
+        while (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire) >= (uint32_t)_slots)
+        {
+            if (_cancelled.load(std::memory_order_relaxed))
+                return false;
+
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+        }
+
+        if (_cancelled.load(std::memory_order_relaxed))
+            return false;
+
+        uint8_t *slot = _memory + (_head.load(std::memory_order_relaxed) % _slots) * _slotSize;
+        size_t amount = min(length, _slotSize - _filling);
+        memcpy(slot + _filling, data, amount);
+
+        _filling += amount;
+        data += amount;
+        length -= amount;
+
+        if (_filling == _slotSize)
+            publish();
+    }
+
+    return !_cancelled.load(std::memory_order_relaxed);
+}
+
+void SpotifyImagePipeline::publish()
+{
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    _lengths[head % _slots] = _filling;
+    _filling = 0;
+
+    _head.store(head + 1, std::memory_order_release);
+    xTaskNotifyGive(_decoderTask);
+}
+
+void SpotifyImagePipeline::decoderTask(void *parameter)
+{
+    SpotifyImagePipeline *pipeline = static_cast<SpotifyImagePipeline*>(parameter);
+
+    while (true)
+    {
+        uint32_t tail = pipeline->_tail.load(std::memory_order_relaxed);
+
+        if (tail == pipeline->_head.load(std::memory_order_acquire))
+        {
+            /* Check the head again, a block may have landed just before the download finished. */
+            if (pipeline->_finished.load(std::memory_order_acquire) && tail == pipeline->_head.load(std::memory_order_acquire))
+                break;
+
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        /* After a cancel, blocks are just drained so the download can finish. */
+        if (!pipeline->_cancelled.load(std::memory_order_relaxed))
+        {
+            unsigned long start = millis();
+            if (tail == 0)
+                pipeline->_stats.firstBlockMs = start - pipeline->_startMs;
+
+            uint8_t *slot = pipeline->_memory + (tail % pipeline->_slots) * pipeline->_slotSize;
+            if (!pipeline->_decoder(slot, pipeline->_lengths[tail % pipeline->_slots]))
+                pipeline->_cancelled.store(true, std::memory_order_relaxed);
+
+            pipeline->_stats.decodeMs += millis() - start;
+        }
+
+        pipeline->_tail.store(tail + 1, std::memory_order_release);
+        xTaskNotifyGive(pipeline->_producerTask);
+    }
+
+    /* Once run() sees the flag it may return and the pipeline go away, so nothing of it is touched after. */
+    TaskHandle_t producer = pipeline->_producerTask;
+    pipeline->_decoderDone.store(true, std::memory_order_release);
+    xTaskNotifyGive(producer);
+
+    /* run() deletes this task. */
+    vTaskSuspend(NULL);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "SpotifyConfig.h"
+#include "SpotifyStructs.h"
+
+class SpotifyESP;
+
+/** @brief How long each half of the last pipelined image took. */
+struct SpotifyImagePipelineStats {
+    uint32_t bytes;
+    uint32_t firstBlockMs; /** @brief From the start until the decoder had its first block. */
+    uint32_t downloadMs; /** @brief Until the last byte was read. */
+    uint32_t decodeMs; /** @brief Time spent inside the decode callback. */
+    uint32_t totalMs; /** @brief Until the decoder was done with the last block. */
+};
+
+/** @brief Downloads an image on one core while it's decoded on the other.
+ *
+ * Normally an image is downloaded in full, then decoded, then drawn. Here
+ * the download runs in the calling task and fills fixed blocks of a ring,
+ * while a decoder task pinned to the other core is handed each block as soon
+ * as it's full. The ring has one writer and one reader, so the two only
+ * share a pair of atomic indices and wake each other with task
+ * notifications. The whole cover then takes about as long as the slower of
+ * the two rather than both added up.
+ *
+ * The callback runs on the decoder task, not the caller's. It must not use
+ * the @ref SpotifyESP object, which is busy downloading.
+ *
+ * On a single core chip, unless @ref decoderCore says otherwise, there's no
+ * decoder task and each block is decoded in the calling task as it arrives.
+ * That's also what happens when the ring or the task can't be created.
+ *
+ * @code{cpp}
+ * SpotifyImagePipeline pipeline([](const uint8_t *data, size_t length) {
+ *     return decoder.feed(data, length);
+ * });
+ *
+ * size_t length;
+ * if (spotify.requestImage(url, &length) == SpotifyResult::eSuccess)
+ *     pipeline.run(spotify);
+ * @endcode
+ *
+ */
+class SpotifyImagePipeline {
+public:
+    SpotifyImagePipeline(SpotifyCallbackOnImageData decoder, int slots = SPOTIFY_IMAGE_PIPELINE_SLOTS, size_t slotSize = SPOTIFY_IMAGE_BLOCK_SIZE);
+    ~SpotifyImagePipeline();
+
+    SpotifyImagePipeline(const SpotifyImagePipeline&) = delete;
+    SpotifyImagePipeline& operator=(const SpotifyImagePipeline&) = delete;
+
+    /** @brief The ring could be allocated. */
+    bool valid() const { return _memory != nullptr; }
+
+    /** @brief Reads the image from @ref SpotifyESP::requestImage through the decoder.
+     *
+     * Blocks until the image has been downloaded and the decoder has seen
+     * every byte of it, or either side stopped.
+     *
+     * @param[in] spotify The object the image was requested with.
+     *
+     * @return The result of reading the image, it's a success if the decoder stopped early.
+     */
+    SpotifyResult run(SpotifyESP &spotify);
+
+    SpotifyImagePipelineStats getStats() const { return _stats; }
+
+    int decoderCore = -1; /** @brief Core the decoder runs on, -1 picks the one the caller isn't on, or decodes inline on a single core chip. */
+    UBaseType_t decoderPriority = 1;
+    uint32_t decoderStackSize = SPOTIFY_IMAGE_PIPELINE_STACK;
+
+private:
+    static void decoderTask(void *parameter);
+    SpotifyResult decodeInline(SpotifyESP &spotify);
+
+    bool push(const uint8_t *data, size_t length);
+    void publish();
+
+    SpotifyCallbackOnImageData _decoder;
+    int _slots;
+    size_t _slotSize;
+    uint8_t *_memory;
+    size_t *_lengths;
+
+    /* Only the producer writes _head, only the decoder writes _tail. */
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    std::atomic<bool> _finished;
+    std::atomic<bool> _cancelled;
+    std::atomic<bool> _decoderDone;
+    size_t _filling;
+
+    TaskHandle_t _producerTask;
+    TaskHandle_t _decoderTask;
+
+    unsigned long _startMs;
+    SpotifyImagePipelineStats _stats;
+};
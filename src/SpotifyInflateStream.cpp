@@ -0,0 +1,242 @@
+#include <esp_heap_caps.h>
+
+#include "SpotifyInflateStream.h"
+
+/* Deflate can reference up to 32KB back, the window can't be any smaller. */
+static const size_t windowSize = 32768;
+
+/* gzip header flags, RFC 1952. */
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+
+static void* allocateLarge(size_t size)
+{
+    void *memory = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return memory ? memory : malloc(size);
+}
+
+SpotifyInflateStream::SpotifyInflateStream(Stream &source, SpotifyContentEncoding encoding)
+    : _source(source)
+    , _encoding(encoding)
+    , _valid(false)
+    , _done(false)
+#if SPOTIFY_HAS_INFLATE
+    , _inflater(nullptr)
+#endif
+    , _window(nullptr)
+    , _windowOffset(0)
+    , _readPosition(0)
+    , _readEnd(0)
+    , _inputPosition(0)
+    , _inputLength(0)
+    , _sourceDone(false)
+    , _compressedBytes(0)
+    , _decompressedBytes(0)
+{
+    setTimeout(SPOTIFY_TIMEOUT);
+
+#if SPOTIFY_HAS_INFLATE
+    _inflater = (tinfl_decompressor*)allocateLarge(sizeof(tinfl_decompressor));
+    _window = (uint8_t*)allocateLarge(windowSize);
+
+    if (!_inflater || !_window)
+    {
+        log_e("Not enough memory to inflate the response");
+        return;
+    }
+
+    tinfl_init(_inflater);
+
+    _valid = (_encoding != SpotifyContentEncoding::eGzip) || skipGzipHeader();
+    if (!_valid)
+        log_e("Response isn't valid gzip");
+#else
+    log_e("Can't inflate responses on this chip");
+#endif
+}
+
+SpotifyInflateStream::~SpotifyInflateStream()
+{
+#if SPOTIFY_HAS_INFLATE
+    free(_inflater);
+#endif
+    free(_window);
+}
+
+bool SpotifyInflateStream::canAllocate()
+{
+#if SPOTIFY_HAS_INFLATE
+    size_t needed = windowSize + sizeof(tinfl_decompressor);
+    return heap_caps_get_free_size(MALLOC_CAP_SPIRAM) >= needed
+        || heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) >= windowSize + SPOTIFY_TLS_SESSION_HEAP;
+#else
+    return false;
+#endif
+}
+
+int SpotifyInflateStream::available()
+{
+    if (_readPosition < _readEnd)
+        return _readEnd - _readPosition;
+
+    return (_valid && !_done) ? 1 : 0;
+}
+
+int SpotifyInflateStream::read()
+{
+    if (_readPosition >= _readEnd && !inflateMore())
+        return -1;
+
+    return _window[_readPosition++];
+}
+
+int SpotifyInflateStream::peek()
+{
+    if (_readPosition >= _readEnd && !inflateMore())
+        return -1;
+
+    return _window[_readPosition];
+}
+
+size_t SpotifyInflateStream::readBytes(char *buffer, size_t length)
+{
+    size_t copied = 0;
+
+    while (copied < length)
+    {
+        if (_readPosition >= _readEnd && !inflateMore())
+            break;
+
+        size_t amount = min(length - copied, _readEnd - _readPosition);
+        memcpy(buffer + copied, _window + _readPosition, amount);
+        _readPosition += amount;
+        copied += amount;
+    }
+
+    return copied;
+}
+
+bool SpotifyInflateStream::skipGzipHeader()
+{
+    uint8_t header[10];
+    if (_source.readBytes(header, sizeof(header)) != sizeof(header))
+        return false;
+
+    _compressedBytes += sizeof(header);
+
+    /* Magic number and the deflate method. */
+    if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8)
+        return false;
+
+    uint8_t flags = header[3];
+
+    if (flags & GZIP_FEXTRA)
+    {
+        uint8_t extraLength[2];
+        if (_source.readBytes(extraLength, 2) != 2)
+            return false;
+
+        size_t skip = extraLength[0] | (extraLength[1] << 8);
+        for (size_t i = 0; i < skip; i++)
+            if (_source.read() < 0)
+                return false;
+
+        _compressedBytes += 2 + skip;
+    }
+
+    /* The file name and comment are zero terminated. */
+    for (int field : { GZIP_FNAME, GZIP_FCOMMENT })
+    {
+        if (!(flags & field))
+            continue;
+
+        int c;
+        do {
+            c = _source.read();
+            _compressedBytes++;
+        } while (c > 0);
+
+        if (c < 0)
+            return false;
+    }
+
+    if (flags & GZIP_FHCRC)
+    {
+        _source.read();
+        _source.read();
+        _compressedBytes += 2;
+    }
+
+    return true;
+}
+
+bool SpotifyInflateStream::inflateMore()
+{
+#if SPOTIFY_HAS_INFLATE
+    if (!_valid || _done)
+        return false;
+
+    while (true)
+    {
+        /* Top up the input, only waiting when there is nothing at all to work with. */
+        if (_inputPosition >= _inputLength && !_sourceDone)
+        {
+            size_t wanted = constrain(_source.available(), 1, (int)sizeof(_input));
+            _inputLength = _source.readBytes(_input, wanted);
+            _inputPosition = 0;
+            _compressedBytes += _inputLength;
+
+            if (_inputLength == 0)
+                _sourceDone = true;
+        }
+
+        size_t inputSize = _inputLength - _inputPosition;
+        size_t outputSize = windowSize - _windowOffset;
+
+        mz_uint32 flags = _sourceDone ? 0 : TINFL_FLAG_HAS_MORE_INPUT;
+        if (_encoding == SpotifyContentEncoding::eDeflate)
+            flags |= TINFL_FLAG_PARSE_ZLIB_HEADER;
+
+        tinfl_status status = tinfl_decompress(_inflater,
+            _input + _inputPosition, &inputSize,
+            _window, _window + _windowOffset, &outputSize,
+            flags);
+
+        _inputPosition += inputSize;
+
+        if (outputSize > 0)
+        {
+            /* The output never wraps within one call, so it can be read in place. */
+            _readPosition = _windowOffset;
+            _readEnd = _windowOffset + outputSize;
+            _windowOffset = (_windowOffset + outputSize) & (windowSize - 1);
+            _decompressedBytes += outputSize;
+            return true;
+        }
+
+        if (status == TINFL_STATUS_DONE)
+        {
+            _done = true;
+            return false;
+        }
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            log_e("Inflating the response failed: %d", status);
+            _done = true;
+            return false;
+        }
+
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && _sourceDone)
+        {
+            log_e("Compressed response ended early");
+            _done = true;
+            return false;
+        }
+    }
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyConfig.h"
+
+#if __has_include(<rom/miniz.h>)
+#include <rom/miniz.h>
+#define SPOTIFY_HAS_INFLATE 1
+#elif __has_include(<esp32/rom/miniz.h>)
+#include <esp32/rom/miniz.h>
+#define SPOTIFY_HAS_INFLATE 1
+#elif __has_include(<esp32s3/rom/miniz.h>)
+#include <esp32s3/rom/miniz.h>
+#define SPOTIFY_HAS_INFLATE 1
+#elif __has_include(<esp32s2/rom/miniz.h>)
+#include <esp32s2/rom/miniz.h>
+#define SPOTIFY_HAS_INFLATE 1
+#elif __has_include(<esp32c3/rom/miniz.h>)
+#include <esp32c3/rom/miniz.h>
+#define SPOTIFY_HAS_INFLATE 1
+#else
+#define SPOTIFY_HAS_INFLATE 0 // No inflater in ROM, responses are never requested compressed
+#endif
+
+/** @brief How a response body was encoded by the server. */
+enum class SpotifyContentEncoding {
+    eIdentity,
+    eGzip,
+    eDeflate
+};
+
+/** @brief Inflates a gzip or deflate response as it's being read.
+ *
+ * Uses the inflater that lives in the ESP32's ROM. The compressed body is
+ * fed in small pieces and the output is read straight out of the inflater's
+ * window, so the full body is never held in memory. Deflate allows
+ * references 32KB back, so the window has to be that size, it's allocated
+ * from PSRAM when there is some.
+ *
+ * The gzip trailer (CRC and size) isn't checked, a truncated body shows up
+ * as incomplete JSON anyway.
+ *
+ */
+class SpotifyInflateStream : public Stream {
+public:
+    SpotifyInflateStream(Stream &source, SpotifyContentEncoding encoding);
+    ~SpotifyInflateStream();
+
+    SpotifyInflateStream(const SpotifyInflateStream&) = delete;
+    SpotifyInflateStream& operator=(const SpotifyInflateStream&) = delete;
+
+    /** @brief Whether the window and inflater could be allocated right now. */
+    static bool canAllocate();
+
+    /** @brief The inflater was allocated and the header made sense. */
+    bool valid() const { return _valid; }
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+    /* Responses are only read, writing does nothing. */
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+    size_t compressedBytes() const { return _compressedBytes; } /** @brief Bytes read off the wire so far. */
+    size_t decompressedBytes() const { return _decompressedBytes; } /** @brief Bytes handed to the reader so far. */
+
+private:
+    bool skipGzipHeader();
+    bool inflateMore();
+
+    Stream &_source;
+    SpotifyContentEncoding _encoding;
+    bool _valid;
+    bool _done;
+
+#if SPOTIFY_HAS_INFLATE
+    tinfl_decompressor *_inflater;
+#endif
+    uint8_t *_window;
+    size_t _windowOffset;
+    size_t _readPosition;
+    size_t _readEnd;
+
+    uint8_t _input[SPOTIFY_INFLATE_INPUT_SIZE];
+    size_t _inputPosition;
+    size_t _inputLength;
+    bool _sourceDone;
+
+    size_t _compressedBytes;
+    size_t _decompressedBytes;
+};
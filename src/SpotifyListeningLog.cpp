@@ -0,0 +1,196 @@
+#include <esp_heap_caps.h>
+
+#include "SpotifyListeningLog.h"
+
+#define SPOTIFY_LISTENING_LOG_MAGIC 0x4c4c5053 // "SPLL"
+
+/* Written at the start of the log file, followed by the ring of entries. */
+struct SpotifyListeningLogHeader {
+    uint32_t magic;
+    int32_t capacity;
+    int32_t head;
+    int32_t count;
+    uint64_t cursor;
+};
+
+SpotifyListeningLog::SpotifyListeningLog(SpotifyESP &spotify, fs::FS &fs, int capacity, const char *path)
+    : _spotify(spotify)
+    , _fs(fs)
+    , _capacity(capacity)
+    , _path(path)
+    , _head(0)
+    , _count(0)
+    , _cursor(0)
+{
+}
+
+bool SpotifyListeningLog::begin()
+{
+    fs::File file = _fs.open(_path, FILE_READ);
+    if (file)
+    {
+        SpotifyListeningLogHeader header;
+        bool valid = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header)
+                  && header.magic == SPOTIFY_LISTENING_LOG_MAGIC
+                  && header.capacity == _capacity
+                  && file.size() == sizeof(header) + _capacity * sizeof(SpotifyPlayedEntry);
+        file.close();
+
+        if (valid)
+        {
+            _head = header.head;
+            _count = header.count;
+            _cursor = header.cursor;
+            return true;
+        }
+
+        log_w("Listening log doesn't match, starting over");
+    }
+
+    return clear();
+}
+
+SpotifyResult SpotifyListeningLog::sync(int *added)
+{
+    if (added)
+        *added = 0;
+
+    /* Plays arrive newest first, hold them so they can be written oldest first. */
+    size_t size = SPOTIFY_MAX_RECENTLY_PLAYED * sizeof(SpotifyPlayedEntry);
+    SpotifyPlayedEntry *plays = (SpotifyPlayedEntry*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!plays)
+        plays = (SpotifyPlayedEntry*)malloc(size);
+
+    if (!plays)
+        return SpotifyResult::eNoMemory;
+
+    int received = 0;
+    SpotifyResult result = _spotify.getRecentlyPlayed([&](SpotifyTrack track, uint64_t playedAtMs, int index, int numTracks) {
+        /* The cursor is exclusive, but don't trust a play at or before it twice. */
+        if (playedAtMs <= _cursor || received >= SPOTIFY_MAX_RECENTLY_PLAYED)
+            return true;
+
+        SpotifyPlayedEntry &entry = plays[received++];
+        memset(&entry, 0, sizeof(entry));
+        entry.playedAtMs = playedAtMs;
+        strncpy(entry.trackName, track.trackName, sizeof(entry.trackName)-1);
+        strncpy(entry.trackUri, track.trackUri, sizeof(entry.trackUri)-1);
+        if (track.numArtists > 0)
+            strncpy(entry.artistName, track.artists[0].artistName, sizeof(entry.artistName)-1);
+
+        return true;
+    }, _cursor);
+
+    if (result != SpotifyResult::eSuccess || received == 0)
+    {
+        free(plays);
+        return result;
+    }
+
+    fs::File file = _fs.open(_path, "r+");
+    if (!file)
+    {
+        free(plays);
+        log_e("Could not open %s", _path);
+        return SpotifyResult::eUnknown;
+    }
+
+    bool written = true;
+    for (int i = received - 1; i >= 0 && written; i--)
+    {
+        written = file.seek(sizeof(SpotifyListeningLogHeader) + _head * sizeof(SpotifyPlayedEntry))
+               && file.write((const uint8_t*)&plays[i], sizeof(SpotifyPlayedEntry)) == sizeof(SpotifyPlayedEntry);
+
+        _head = (_head + 1) % _capacity;
+        _count = min(_count + 1, _capacity);
+        _cursor = max(_cursor, plays[i].playedAtMs);
+    }
+
+    /* The header goes last, a sync cut short leaves the cursor behind and the plays are fetched again. */
+    written = written && writeHeader(file);
+    file.close();
+    free(plays);
+
+    if (!written)
+    {
+        log_e("Could not write the listening log");
+        begin();
+        return SpotifyResult::eUnknown;
+    }
+
+    log_d("Logged %d new plays", received);
+
+    if (added)
+        *added = received;
+
+    return SpotifyResult::eSuccess;
+}
+
+bool SpotifyListeningLog::forEach(SpotifyCallbackOnPlayedEntry callback)
+{
+    fs::File file = _fs.open(_path, FILE_READ);
+    if (!file)
+        return false;
+
+    int oldest = (_head - _count + _capacity) % _capacity;
+
+    SpotifyPlayedEntry entry;
+    for (int i = 0; i < _count; i++)
+    {
+        int slot = (oldest + i) % _capacity;
+        if (!file.seek(sizeof(SpotifyListeningLogHeader) + slot * sizeof(SpotifyPlayedEntry))
+            || file.read((uint8_t*)&entry, sizeof(entry)) != sizeof(entry))
+            break;
+
+        if (!callback(entry, i, _count))
+            break;
+    }
+
+    file.close();
+    return true;
+}
+
+bool SpotifyListeningLog::clear()
+{
+    _head = 0;
+    _count = 0;
+    _cursor = 0;
+
+    /* Make sure the directory the log lives in exists. */
+    const char *slash = strrchr(_path, '/');
+    if (slash && slash != _path)
+    {
+        char directory[48];
+        snprintf(directory, min(sizeof(directory), (size_t)(slash - _path + 1)), "%s", _path);
+        _fs.mkdir(directory);
+    }
+
+    fs::File file = _fs.open(_path, FILE_WRITE);
+    if (!file)
+    {
+        log_e("Could not create %s", _path);
+        return false;
+    }
+
+    /* Every slot is written up front, not every file system can seek past the end. */
+    bool written = writeHeader(file);
+
+    SpotifyPlayedEntry empty = {};
+    for (int i = 0; i < _capacity && written; i++)
+        written = file.write((const uint8_t*)&empty, sizeof(empty)) == sizeof(empty);
+
+    file.close();
+    return written;
+}
+
+bool SpotifyListeningLog::writeHeader(fs::File &file)
+{
+    SpotifyListeningLogHeader header = {};
+    header.magic = SPOTIFY_LISTENING_LOG_MAGIC;
+    header.capacity = _capacity;
+    header.head = _head;
+    header.count = _count;
+    header.cursor = _cursor;
+
+    return file.seek(0) && file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+}
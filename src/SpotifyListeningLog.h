@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "SpotifyESP.h"
+
+/** @brief One play kept in the listening log. */
+struct SpotifyPlayedEntry {
+    uint64_t playedAtMs; /** @brief When the track was played, Unix milliseconds. */
+    char trackName[SPOTIFY_NAME_CHAR_LENGTH];
+    char trackUri[SPOTIFY_URI_CHAR_LENGTH];
+    char artistName[SPOTIFY_NAME_CHAR_LENGTH]; /** @brief The first artist. */
+};
+
+using SpotifyCallbackOnPlayedEntry = std::function<bool(const SpotifyPlayedEntry &entry, int index, int numEntries)>;
+
+/** @brief Keeps the user's listening history on flash.
+ *
+ * Spotify only remembers the last 50 plays. Each sync asks for the plays
+ * after the newest one already logged, so an unchanged history costs one
+ * small request with nothing to parse. New plays are added to a fixed size
+ * ring in a single file, overwriting the oldest once it's full, and the
+ * cursor is stored with it so it survives a reboot.
+ *
+ * @code{cpp}
+ * SpotifyListeningLog history(spotify, LittleFS);
+ *
+ * history.begin();
+ * history.sync();
+ * history.forEach([](const SpotifyPlayedEntry &entry, int index, int numEntries) {
+ *     Serial.println(entry.trackName);
+ *     return true;
+ * });
+ * @endcode
+ *
+ */
+class SpotifyListeningLog {
+public:
+    SpotifyListeningLog(SpotifyESP &spotify, fs::FS &fs, int capacity = SPOTIFY_LISTENING_LOG_ENTRIES, const char *path = SPOTIFY_LISTENING_LOG_PATH);
+
+    /** @brief Opens the log, creating it when there is none, call after mounting the file system.
+     *
+     * @return True on -- the log is ready.
+     */
+    bool begin();
+
+    /** @brief Adds the plays since the last sync.
+     *
+     * @param[out] added optional, The number of new plays.
+     *
+     * @return True on -- the log is up to date.
+     */
+    SpotifyResult sync(int *added = nullptr);
+
+    /** @brief Reads the log from the oldest play to the newest, return false to stop. */
+    bool forEach(SpotifyCallbackOnPlayedEntry callback);
+
+    /** @brief The number of plays in the log. */
+    int count() const { return _count; }
+
+    /** @brief When the newest logged play was played, Unix milliseconds. */
+    uint64_t cursor() const { return _cursor; }
+
+    /** @brief Empties the log, the next sync starts from the latest 50 plays again. */
+    bool clear();
+
+private:
+    bool writeHeader(fs::File &file);
+
+    SpotifyESP &_spotify;
+    fs::FS &_fs;
+    int _capacity;
+    const char *_path;
+
+    int _head; // Slot the next play goes in
+    int _count;
+    uint64_t _cursor;
+};
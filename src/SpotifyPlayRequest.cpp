@@ -0,0 +1,107 @@
+#include "SpotifyPlayRequest.h"
+
+SpotifyPlayRequest& SpotifyPlayRequest::context(const char *uri)
+{
+    _context = uri;
+    return *this;
+}
+
+SpotifyPlayRequest& SpotifyPlayRequest::tracks(const char *const *uris, int count)
+{
+    _uris = uris;
+    _numUris = count;
+    return *this;
+}
+
+SpotifyPlayRequest& SpotifyPlayRequest::offset(int index)
+{
+    _offsetIndex = index;
+    _offsetUri = nullptr;
+    return *this;
+}
+
+SpotifyPlayRequest& SpotifyPlayRequest::offset(const char *uri)
+{
+    _offsetUri = uri;
+    _offsetIndex = -1;
+    return *this;
+}
+
+SpotifyPlayRequest& SpotifyPlayRequest::position(long positionMs)
+{
+    _positionMs = positionMs;
+    return *this;
+}
+
+void SpotifyPlayRequest::write(Print &out) const
+{
+    bool first = true;
+    auto key = [&](const char *name) {
+        out.print(first ? "{\"" : ",\"");
+        out.print(name);
+        out.print("\":");
+        first = false;
+    };
+
+    if (_context)
+    {
+        key("context_uri");
+        writeString(out, _context);
+    }
+
+    if (_numUris > 0)
+    {
+        key("uris");
+        writeStrings(out, _uris, _numUris);
+    }
+
+    if (_offsetUri)
+    {
+        key("offset");
+        out.print("{\"uri\":");
+        writeString(out, _offsetUri);
+        out.write('}');
+    }
+    else if (_offsetIndex >= 0)
+    {
+        key("offset");
+        out.printf("{\"position\":%d}", _offsetIndex);
+    }
+
+    if (_positionMs >= 0)
+    {
+        key("position_ms");
+        out.print(_positionMs);
+    }
+
+    out.print(first ? "{}" : "}");
+}
+
+bool SpotifyPlayRequest::valid() const
+{
+    if (_context && _numUris > 0)
+        return false;
+
+    if (_context && !_context[0])
+        return false;
+
+    for (int i = 0; i < _numUris; i++)
+        if (!_uris[i] || !_uris[i][0])
+            return false;
+
+    bool hasOffset = _offsetUri || _offsetIndex >= 0;
+    if (hasOffset && !_context && _numUris == 0)
+        return false;
+
+    if (_numUris > 0 && _offsetIndex >= _numUris)
+        return false;
+
+    return true;
+}
+
+void SpotifyTransferRequest::write(Print &out) const
+{
+    out.print("{\"device_ids\":[");
+    writeString(out, _deviceId);
+    out.print(_play ? "],\"play\":true}" : "],\"play\":false}");
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyRequestBody.h"
+
+/** @brief What to start playing, for @ref SpotifyESP::play.
+ *
+ * Either a context (an album, playlist or artist) or a list of tracks, and
+ * optionally where in it to start. With neither, playback just resumes.
+ * Strings are not copied, they must stay valid until the request is sent.
+ *
+ * @code{cpp}
+ * const char *tracks[] = { "spotify:track:4iV5W9uYEdYUVa79Axb7Rh", "spotify:track:1301WleyT98MSxVHPZCA6M" };
+ *
+ * SpotifyPlayRequest request;
+ * request.tracks(tracks, 2).offset(1).position(30000);
+ * spotify.play(request);
+ * @endcode
+ *
+ * @url https://developer.spotify.com/documentation/web-api/reference/start-a-users-playback
+ */
+class SpotifyPlayRequest : public SpotifyRequestBody {
+public:
+    /** @brief Plays an album, playlist or artist. */
+    SpotifyPlayRequest& context(const char *uri);
+
+    /** @brief Plays a list of tracks. */
+    SpotifyPlayRequest& tracks(const char *const *uris, int count);
+
+    /** @brief Starts at an item of the context or track list, counting from 0. */
+    SpotifyPlayRequest& offset(int index);
+
+    /** @brief Starts at an item of the context or track list. */
+    SpotifyPlayRequest& offset(const char *uri);
+
+    /** @brief Starts this far into the first track. */
+    SpotifyPlayRequest& position(long positionMs);
+
+    void write(Print &out) const override;
+
+    /** @brief False when both a context and tracks are set, an offset has nothing to apply to or is out of the list. */
+    bool valid() const override;
+
+private:
+    const char *_context = nullptr;
+    const char *const *_uris = nullptr;
+    int _numUris = 0;
+    int _offsetIndex = -1;
+    const char *_offsetUri = nullptr;
+    long _positionMs = -1;
+};
+
+/** @brief Moves playback to another device, for @ref SpotifyESP::transferPlayback.
+ *
+ * @url https://developer.spotify.com/documentation/web-api/reference/transfer-a-users-playback
+ */
+class SpotifyTransferRequest : public SpotifyRequestBody {
+public:
+    SpotifyTransferRequest(const char *deviceId, bool play)
+        : _deviceId(deviceId), _play(play) {}
+
+    void write(Print &out) const override;
+    bool valid() const override { return _deviceId && _deviceId[0]; }
+
+private:
+    const char *_deviceId;
+    bool _play;
+};
@@ -0,0 +1,220 @@
+#include "SpotifyPlaylistSync.h"
+
+#define SPOTIFY_PLAYLIST_MAGIC 0x4c505053 // "SPPL"
+
+/* Written at the start of each playlist file, followed by the entries. */
+struct SpotifyPlaylistHeader {
+    uint32_t magic;
+    int32_t count;
+    char snapshotId[SPOTIFY_SNAPSHOT_ID_CHAR_LENGTH];
+};
+
+SpotifyPlaylistSync::SpotifyPlaylistSync(SpotifyESP &spotify, fs::FS &fs, const char *directory)
+    : _spotify(spotify)
+    , _fs(fs)
+    , _directory(directory)
+{
+}
+
+SpotifyResult SpotifyPlaylistSync::sync(const char *playlist, bool *changed)
+{
+    if (changed)
+        *changed = false;
+
+    char remoteSnapshot[SPOTIFY_SNAPSHOT_ID_CHAR_LENGTH];
+    SpotifyResult result = _spotify.getPlaylistSnapshotId(playlist, remoteSnapshot, sizeof(remoteSnapshot));
+    if (result != SpotifyResult::eSuccess)
+        return result;
+
+    char localSnapshot[SPOTIFY_SNAPSHOT_ID_CHAR_LENGTH];
+    if (snapshotId(playlist, localSnapshot, sizeof(localSnapshot)) && strcmp(localSnapshot, remoteSnapshot) == 0)
+    {
+        log_d("Playlist is unchanged");
+        return SpotifyResult::eSuccess;
+    }
+
+    _fs.mkdir(_directory);
+
+    char temporaryPath[48];
+    char playlistPath[48];
+    path(temporaryPath, sizeof(temporaryPath), playlist, "tmp");
+    path(playlistPath, sizeof(playlistPath), playlist, "bin");
+
+    fs::File file = _fs.open(temporaryPath, FILE_WRITE);
+    if (!file)
+    {
+        log_e("Could not create %s", temporaryPath);
+        return SpotifyResult::eUnknown;
+    }
+
+    /* The magic is only written once the file is complete, a half written one is never read back. */
+    SpotifyPlaylistHeader header = {};
+    strncpy(header.snapshotId, remoteSnapshot, sizeof(header.snapshotId)-1);
+    file.write((const uint8_t*)&header, sizeof(header));
+
+    bool written = true;
+    result = _spotify.getPlaylistTracks(playlist, [&](SpotifyTrack track, int index, int numTracks) {
+        SpotifyPlaylistEntry entry = {};
+        strncpy(entry.trackName, track.trackName, sizeof(entry.trackName)-1);
+        strncpy(entry.trackUri, track.trackUri, sizeof(entry.trackUri)-1);
+        strncpy(entry.albumName, track.albumName, sizeof(entry.albumName)-1);
+        if (track.numArtists > 0)
+            strncpy(entry.artistName, track.artists[0].artistName, sizeof(entry.artistName)-1);
+
+        written = file.write((const uint8_t*)&entry, sizeof(entry)) == sizeof(entry);
+        header.count++;
+        return written;
+    });
+
+    /* The count is only known once every page has been read. */
+    header.magic = SPOTIFY_PLAYLIST_MAGIC;
+    written = written && file.seek(0) && file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    file.close();
+
+    if (result != SpotifyResult::eSuccess || !written)
+    {
+        log_e("Playlist sync failed, keeping the old copy");
+        _fs.remove(temporaryPath);
+        return (result != SpotifyResult::eSuccess) ? result : SpotifyResult::eUnknown;
+    }
+
+    /* Not every file system will rename over an existing file, only those
+     * that won't are left without a copy until the rename is done. */
+    if (!_fs.rename(temporaryPath, playlistPath) && !(_fs.remove(playlistPath) && _fs.rename(temporaryPath, playlistPath)))
+    {
+        log_e("Could not move %s into place", temporaryPath);
+        _fs.remove(temporaryPath);
+        return SpotifyResult::eUnknown;
+    }
+
+    log_d("Synced %d tracks at snapshot %s", header.count, remoteSnapshot);
+
+    if (changed)
+        *changed = true;
+
+    return SpotifyResult::eSuccess;
+}
+
+bool SpotifyPlaylistSync::forEach(const char *playlist, SpotifyCallbackOnPlaylistEntry callback)
+{
+    fs::File file = openCopy(playlist);
+    if (!file)
+        return false;
+
+    int count;
+    if (!readHeader(file, nullptr, &count))
+    {
+        file.close();
+        return false;
+    }
+
+    SpotifyPlaylistEntry entry;
+    for (int i = 0; i < count; i++)
+    {
+        if (file.read((uint8_t*)&entry, sizeof(entry)) != sizeof(entry))
+            break;
+
+        if (!callback(entry, i, count))
+            break;
+    }
+
+    file.close();
+    return true;
+}
+
+int SpotifyPlaylistSync::count(const char *playlist)
+{
+    fs::File file = openCopy(playlist);
+    if (!file)
+        return -1;
+
+    int count = -1;
+    if (!readHeader(file, nullptr, &count))
+        count = -1;
+
+    file.close();
+    return count;
+}
+
+bool SpotifyPlaylistSync::snapshotId(const char *playlist, char *snapshotId, size_t length)
+{
+    fs::File file = openCopy(playlist);
+    if (!file)
+        return false;
+
+    char stored[SPOTIFY_SNAPSHOT_ID_CHAR_LENGTH];
+    bool valid = readHeader(file, stored, nullptr);
+    file.close();
+
+    if (!valid)
+        return false;
+
+    strncpy(snapshotId, stored, length-1);
+    snapshotId[length-1] = '\0';
+    return true;
+}
+
+void SpotifyPlaylistSync::remove(const char *playlist)
+{
+    char playlistPath[48];
+    path(playlistPath, sizeof(playlistPath), playlist, "bin");
+    _fs.remove(playlistPath);
+
+    path(playlistPath, sizeof(playlistPath), playlist, "tmp");
+    _fs.remove(playlistPath);
+}
+
+fs::File SpotifyPlaylistSync::openCopy(const char *playlist)
+{
+    char playlistPath[48];
+    path(playlistPath, sizeof(playlistPath), playlist, "bin");
+
+    fs::File file = _fs.open(playlistPath, FILE_READ);
+    if (file)
+        return file;
+
+    /* A sync cut off between removing the old copy and renaming the new one leaves only the new one. */
+    char temporaryPath[48];
+    path(temporaryPath, sizeof(temporaryPath), playlist, "tmp");
+
+    file = _fs.open(temporaryPath, FILE_READ);
+    if (!file)
+        return file;
+
+    bool complete = readHeader(file, nullptr, nullptr);
+    file.close();
+
+    if (!complete)
+        return fs::File();
+
+    if (!_fs.rename(temporaryPath, playlistPath))
+        return _fs.open(temporaryPath, FILE_READ);
+
+    log_d("Recovered %s from an interrupted sync", playlistPath);
+    return _fs.open(playlistPath, FILE_READ);
+}
+
+bool SpotifyPlaylistSync::readHeader(fs::File &file, char *snapshotId, int *count)
+{
+    SpotifyPlaylistHeader header;
+    if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || header.magic != SPOTIFY_PLAYLIST_MAGIC)
+        return false;
+
+    if (snapshotId)
+    {
+        memcpy(snapshotId, header.snapshotId, sizeof(header.snapshotId));
+        snapshotId[sizeof(header.snapshotId)-1] = '\0';
+    }
+
+    if (count)
+        *count = header.count;
+
+    return true;
+}
+
+void SpotifyPlaylistSync::path(char *buffer, size_t length, const char *playlist, const char *extension)
+{
+    /* Hash the id, SPIFFS names are limited to 31 characters. */
+    const char *colon = strrchr(playlist, ':');
+    snprintf(buffer, length, "%s/p%08x.%s", _directory, SpotifyImageCache::hash(colon ? colon + 1 : playlist), extension);
+}
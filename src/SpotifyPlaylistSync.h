@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "SpotifyESP.h"
+
+/** @brief The parts of a playlist track kept on flash. */
+struct SpotifyPlaylistEntry {
+    char trackName[SPOTIFY_NAME_CHAR_LENGTH];
+    char trackUri[SPOTIFY_URI_CHAR_LENGTH];
+    char artistName[SPOTIFY_NAME_CHAR_LENGTH]; /** @brief The first artist. */
+    char albumName[SPOTIFY_NAME_CHAR_LENGTH];
+};
+
+using SpotifyCallbackOnPlaylistEntry = std::function<bool(const SpotifyPlaylistEntry &entry, int index, int numEntries)>;
+
+/** @brief Keeps copies of playlists on flash and only downloads them when they change.
+ *
+ * Every playlist has a snapshot id that changes whenever its contents do.
+ * Each synced playlist is stored in its own file together with the snapshot
+ * id it was fetched at. A sync first asks Spotify for just the snapshot id,
+ * a tiny request, and only pages through the tracks again when it differs.
+ * The new copy is written next to the old one and swapped in once it's
+ * complete, so a failed sync leaves the last good copy in place.
+ *
+ * @code{cpp}
+ * SpotifyPlaylistSync playlists(spotify, LittleFS);
+ *
+ * bool changed;
+ * if (playlists.sync("spotify:playlist:37i9dQZF1DXcBWIGoYBM5M", &changed) == SpotifyResult::eSuccess && changed)
+ *     playlists.forEach("spotify:playlist:37i9dQZF1DXcBWIGoYBM5M", showTrack);
+ * @endcode
+ *
+ */
+class SpotifyPlaylistSync {
+public:
+    SpotifyPlaylistSync(SpotifyESP &spotify, fs::FS &fs, const char *directory = SPOTIFY_PLAYLIST_SYNC_DIRECTORY);
+
+    /** @brief Brings the local copy of a playlist up to date.
+     *
+     * @param[in] playlist The playlist's URI or id.
+     * @param[out] changed optional, Set when the playlist was downloaded again.
+     *
+     * @return True on -- the local copy matches Spotify's.
+     */
+    SpotifyResult sync(const char *playlist, bool *changed = nullptr);
+
+    /** @brief Reads the local copy of a playlist, without any network requests.
+     *
+     * @param[in] playlist The playlist's URI or id.
+     * @param[in] callback Ran for every track, return false to stop.
+     *
+     * @return True on -- there is a local copy.
+     */
+    bool forEach(const char *playlist, SpotifyCallbackOnPlaylistEntry callback);
+
+    /** @brief The number of tracks in the local copy, -1 if there is none. */
+    int count(const char *playlist);
+
+    /** @brief The snapshot id of the local copy.
+     *
+     * @return True on -- there is a local copy.
+     */
+    bool snapshotId(const char *playlist, char *snapshotId, size_t length);
+
+    /** @brief Deletes the local copy of a playlist. */
+    void remove(const char *playlist);
+
+private:
+    fs::File openCopy(const char *playlist); // The local copy, or the new one a sync left behind before moving it into place
+    bool readHeader(fs::File &file, char *snapshotId, int *count);
+    void path(char *buffer, size_t length, const char *playlist, const char *extension);
+
+    SpotifyESP &_spotify;
+    fs::FS &_fs;
+    const char *_directory;
+};
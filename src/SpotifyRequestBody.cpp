@@ -0,0 +1,182 @@
+#include "SpotifyRequestBody.h"
+
+/* Counts what's written without keeping any of it. */
+class SpotifyCountingPrint : public Print {
+public:
+    size_t write(uint8_t) override { count++; return 1; }
+    size_t write(const uint8_t*, size_t length) override { count += length; return length; }
+
+    size_t count = 0;
+};
+
+/* Keeps only the bytes written between two offsets. */
+class SpotifyWindowPrint : public Print {
+public:
+    SpotifyWindowPrint(uint8_t *window, size_t start, size_t capacity)
+        : _window(window), _start(start), _end(start + capacity), _offset(0) {}
+
+    size_t write(uint8_t c) override
+    {
+        if (_offset >= _start && _offset < _end)
+            _window[_offset - _start] = c;
+
+        _offset++;
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t length) override
+    {
+        for (size_t i = 0; i < length; i++)
+            write(buffer[i]);
+
+        return length;
+    }
+
+private:
+    uint8_t *_window;
+    size_t _start;
+    size_t _end;
+    size_t _offset;
+};
+
+size_t SpotifyRequestBody::length() const
+{
+    SpotifyCountingPrint counter;
+    write(counter);
+    return counter.count;
+}
+
+void SpotifyRequestBody::writeString(Print &out, const char *value)
+{
+    out.write('"');
+
+    for (; *value; value++)
+    {
+        char c = *value;
+        if (c == '"' || c == '\\')
+        {
+            out.write('\\');
+            out.write(c);
+        }
+        else if ((uint8_t)c < 0x20)
+        {
+            out.printf("\\u%04x", c);
+        }
+        else
+        {
+            out.write(c);
+        }
+    }
+
+    out.write('"');
+}
+
+void SpotifyRequestBody::writeStrings(Print &out, const char *const *values, int count)
+{
+    out.write('[');
+
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+            out.write(',');
+        writeString(out, values[i]);
+    }
+
+    out.write(']');
+}
+
+void SpotifyIdsRequest::write(Print &out) const
+{
+    out.print("{\"ids\":[");
+
+    for (int i = 0; i < _count; i++)
+    {
+        const char *colon = strrchr(_uris[i], ':');
+        if (i > 0)
+            out.write(',');
+        writeString(out, colon ? colon + 1 : _uris[i]);
+    }
+
+    out.print("]}");
+}
+
+bool SpotifyIdsRequest::valid() const
+{
+    if (_count <= 0)
+        return false;
+
+    for (int i = 0; i < _count; i++)
+        if (!_uris[i] || !_uris[i][0])
+            return false;
+
+    return true;
+}
+
+SpotifyBodyStream::SpotifyBodyStream(const SpotifyRequestBody &body)
+    : _body(body)
+    , _size(body.length())
+    , _offset(0)
+    , _position(0)
+    , _length(0)
+{
+}
+
+void SpotifyBodyStream::rewind()
+{
+    _offset = 0;
+    _position = 0;
+    _length = 0;
+}
+
+int SpotifyBodyStream::available()
+{
+    return _size - (_offset + _position);
+}
+
+int SpotifyBodyStream::read()
+{
+    if (_position >= _length && !fill())
+        return -1;
+
+    return _window[_position++];
+}
+
+int SpotifyBodyStream::peek()
+{
+    if (_position >= _length && !fill())
+        return -1;
+
+    return _window[_position];
+}
+
+size_t SpotifyBodyStream::readBytes(char *buffer, size_t length)
+{
+    size_t copied = 0;
+
+    while (copied < length)
+    {
+        if (_position >= _length && !fill())
+            break;
+
+        size_t amount = min(length - copied, _length - _position);
+        memcpy(buffer + copied, _window + _position, amount);
+        _position += amount;
+        copied += amount;
+    }
+
+    return copied;
+}
+
+bool SpotifyBodyStream::fill()
+{
+    _offset += _length;
+    _position = 0;
+    _length = min(sizeof(_window), _size - _offset);
+
+    if (_length == 0)
+        return false;
+
+    SpotifyWindowPrint window(_window, _offset, _length);
+    _body.write(window);
+    return true;
+}
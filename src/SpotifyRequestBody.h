@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyConfig.h"
+
+/** @brief A JSON request body that is written out when it's sent, never built in memory.
+ *
+ * Bodies only hold pointers to what the caller passed in, which must stay
+ * valid until the request is sent. @ref write may be called several times,
+ * once to measure the body and then as it's streamed.
+ *
+ */
+class SpotifyRequestBody {
+public:
+    virtual ~SpotifyRequestBody() = default;
+
+    /** @brief Writes the whole body out. */
+    virtual void write(Print &out) const = 0;
+
+    /** @brief Whether the body makes sense, checked before anything is sent. */
+    virtual bool valid() const { return true; }
+
+    /** @brief Size of the body in bytes, for the Content-Length. */
+    size_t length() const;
+
+protected:
+    /** @brief Writes a quoted JSON string, escaping what needs it. */
+    static void writeString(Print &out, const char *value);
+
+    /** @brief Writes a JSON array of quoted strings. */
+    static void writeStrings(Print &out, const char *const *values, int count);
+};
+
+/** @brief A list of ids, like the body of saving tracks to the library.
+ *
+ * URIs are accepted too, only the id after their last colon is written.
+ *
+ */
+class SpotifyIdsRequest : public SpotifyRequestBody {
+public:
+    SpotifyIdsRequest(const char *const *uris, int count)
+        : _uris(uris), _count(count) {}
+
+    void write(Print &out) const override;
+    bool valid() const override;
+
+private:
+    const char *const *_uris;
+    int _count;
+};
+
+/** @brief Reads a request body as a stream, for HTTPClient::sendRequest.
+ *
+ * The body is written into a small window a chunk at a time. A body larger
+ * than the window is written again for each chunk with the bytes outside it
+ * skipped, which is cheap next to sending them and keeps memory flat no
+ * matter how large the body is.
+ *
+ */
+class SpotifyBodyStream : public Stream {
+public:
+    SpotifyBodyStream(const SpotifyRequestBody &body);
+
+    SpotifyBodyStream(const SpotifyBodyStream&) = delete;
+    SpotifyBodyStream& operator=(const SpotifyBodyStream&) = delete;
+
+    /** @brief Size of the whole body. */
+    size_t size() const { return _size; }
+
+    /** @brief Starts again from the first byte, to resend the body. */
+    void rewind();
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char *buffer, size_t length);
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+    /* The body is only read, writing does nothing. */
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+private:
+    bool fill();
+
+    const SpotifyRequestBody &_body;
+    size_t _size;
+    size_t _offset; // Of the start of the window within the body
+    size_t _position;
+    size_t _length;
+    uint8_t _window[SPOTIFY_BODY_CHUNK_SIZE];
+};
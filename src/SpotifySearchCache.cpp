@@ -0,0 +1,210 @@
+#include <esp_heap_caps.h>
+
+#include "SpotifySearchCache.h"
+
+SpotifySearchCache::SpotifySearchCache(size_t budgetBytes)
+    : _budget(budgetBytes)
+    , _used(0)
+    , _entries()
+    , _count(0)
+    , _hits(0)
+    , _misses(0)
+    , _expired(0)
+{
+}
+
+SpotifySearchCache::~SpotifySearchCache()
+{
+    clear();
+}
+
+/* Hands a query to emit one character at a time, lowercased, with runs of spaces and plus signs as one space and none at the ends. */
+template <typename Emit>
+static void normalize(const char *query, Emit emit)
+{
+    bool space = false;
+    bool started = false;
+
+    for (; *query; query++)
+    {
+        char c = *query;
+        if (c == ' ' || c == '+' || c == '\t')
+        {
+            space = started;
+            continue;
+        }
+
+        if (space)
+        {
+            emit(' ');
+            space = false;
+        }
+
+        emit((char)tolower((unsigned char)c));
+        started = true;
+    }
+}
+
+uint32_t SpotifySearchCache::key(const char *query, SpotifySearchTypeFlags types, int limit)
+{
+    /* FNV-1a over the normalized query, then the types and limit. */
+    uint32_t hash = 2166136261u;
+
+    normalize(query, [&](char c) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    });
+
+    for (uint32_t value : { (uint32_t)types, (uint32_t)limit })
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 16777619u;
+        }
+    }
+
+    return hash;
+}
+
+const uint8_t* SpotifySearchCache::find(const char *query, SpotifySearchTypeFlags types, int limit, size_t *length)
+{
+    int index = lookup(query, types, limit);
+    if (index < 0)
+    {
+        _misses++;
+        return nullptr;
+    }
+
+    unsigned long now = millis();
+    SpotifySearchCacheEntry &entry = _entries[index];
+
+    if (now - entry.storedMs > ttlMs)
+    {
+        _misses++;
+        _expired++;
+        remove(index);
+        return nullptr;
+    }
+
+    _hits++;
+    entry.lastUsedMs = now;
+
+    if (length)
+        *length = entry.size;
+
+    return entry.data;
+}
+
+bool SpotifySearchCache::insert(const char *query, SpotifySearchTypeFlags types, int limit, const uint8_t *data, size_t length)
+{
+    size_t queryLength = 0;
+    normalize(query, [&](char) { queryLength++; });
+
+    /* The query is charged to the budget along with the results. */
+    size_t total = length + queryLength + 1;
+    if (length == 0 || total > _budget)
+        return false;
+
+    int existing = lookup(query, types, limit);
+    if (existing >= 0)
+        remove(existing);
+
+    while (_count > 0 && (_count >= SPOTIFY_SEARCH_CACHE_ENTRIES || _used + total > _budget))
+    {
+        int oldest = 0;
+        for (int i = 1; i < _count; i++)
+            if ((long)(_entries[i].lastUsedMs - _entries[oldest].lastUsedMs) < 0)
+                oldest = i;
+
+        remove(oldest);
+    }
+
+    uint8_t *copy = (uint8_t*)heap_caps_malloc(total, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!copy)
+        copy = (uint8_t*)malloc(total);
+
+    if (!copy)
+    {
+        log_w("Not enough memory to keep %d bytes of search results", length);
+        return false;
+    }
+
+    memcpy(copy, data, length);
+
+    char *normalized = (char*)copy + length;
+    normalize(query, [&](char c) { *normalized++ = c; });
+    *normalized = '\0';
+
+    SpotifySearchCacheEntry &entry = _entries[_count++];
+    entry.key = key(query, types, limit);
+    entry.types = types;
+    entry.limit = limit;
+    entry.query = (const char*)copy + length;
+    entry.data = copy;
+    entry.size = length;
+    entry.storedMs = millis();
+    entry.lastUsedMs = entry.storedMs;
+
+    _used += total;
+    return true;
+}
+
+void SpotifySearchCache::clear()
+{
+    while (_count > 0)
+        remove(_count - 1);
+}
+
+SpotifySearchCacheStats SpotifySearchCache::getStats()
+{
+    SpotifySearchCacheStats stats;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.expired = _expired;
+    stats.bytesUsed = _used;
+    stats.entries = _count;
+    return stats;
+}
+
+float SpotifySearchCache::hitRatio()
+{
+    uint32_t total = _hits + _misses;
+    return total ? (float)_hits / total : 0.0f;
+}
+
+int SpotifySearchCache::lookup(const char *query, SpotifySearchTypeFlags types, int limit)
+{
+    uint32_t hash = key(query, types, limit);
+
+    for (int i = 0; i < _count; i++)
+    {
+        const SpotifySearchCacheEntry &entry = _entries[i];
+        if (entry.key != hash || entry.types != types || entry.limit != limit)
+            continue;
+
+        /* The hash only narrows it down, the query itself has to match too. */
+        const char *stored = entry.query;
+        bool same = true;
+        normalize(query, [&](char c) {
+            if (same && *stored == c)
+                stored++;
+            else
+                same = false;
+        });
+
+        if (same && *stored == '\0')
+            return i;
+    }
+
+    return -1;
+}
+
+void SpotifySearchCache::remove(int index)
+{
+    free(_entries[index].data);
+    _used -= _entries[index].size + strlen(_entries[index].query) + 1;
+
+    _entries[index] = _entries[--_count];
+    _entries[_count] = {};
+}
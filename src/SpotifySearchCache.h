@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyConfig.h"
+#include "SpotifyStructs.h"
+
+/** @brief The results of one search held in RAM. */
+struct SpotifySearchCacheEntry {
+    uint32_t key; /** @brief See @ref SpotifySearchCache::key. */
+    SpotifySearchTypeFlags types;
+    int limit;
+    const char *query; /** @brief The normalized query, stored right after the results. */
+    uint8_t *data; /** @brief The filtered result items, packed as MessagePack. */
+    size_t size; /** @brief Size of the results alone. */
+    unsigned long storedMs; /** @brief When the results were received. */
+    unsigned long lastUsedMs;
+};
+
+/** @brief How well the search cache is doing. */
+struct SpotifySearchCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t expired; /** @brief Misses because the results were older than the TTL. */
+    uint32_t bytesUsed;
+    int entries;
+};
+
+/** @brief Keeps the results of recent searches in RAM.
+ *
+ * A search box sends the same few queries over and over, backspacing and
+ * typing a letter again shouldn't cost a request. The results of each
+ * search are kept, filtered down to what the callbacks read, for
+ * @ref ttlMs. Queries are compared after lowercasing them and collapsing
+ * spaces, along with the types and limit. When a new result doesn't fit in
+ * the byte budget the least recently used ones are dropped.
+ *
+ * Give it to @ref SpotifyESP::setSearchCache.
+ *
+ */
+class SpotifySearchCache {
+public:
+    SpotifySearchCache(size_t budgetBytes = SPOTIFY_SEARCH_CACHE_BUDGET);
+    ~SpotifySearchCache();
+
+    SpotifySearchCache(const SpotifySearchCache&) = delete;
+    SpotifySearchCache& operator=(const SpotifySearchCache&) = delete;
+
+    /** @brief Hash of a normalized query along with what was asked of it. */
+    static uint32_t key(const char *query, SpotifySearchTypeFlags types, int limit);
+
+    /** @brief Looks results up and marks them as used.
+     *
+     * @param[in] query The search terms as they were typed.
+     * @param[in] types What was searched for.
+     * @param[in] limit Results asked for of each type.
+     * @param[out] length Size of the results in bytes.
+     *
+     * @return The results, owned by the cache, or nullptr on -- they aren't cached or are too old.
+     */
+    const uint8_t* find(const char *query, SpotifySearchTypeFlags types, int limit, size_t *length);
+
+    /** @brief Copies results into the cache, evicting old ones to stay in budget.
+     *
+     * The normalized query is kept along with them, so a query whose hash
+     * collides with another is never answered with the other's results.
+     *
+     * @return True on -- the results were stored.
+     */
+    bool insert(const char *query, SpotifySearchTypeFlags types, int limit, const uint8_t *data, size_t length);
+
+    /** @brief Frees every cached result. */
+    void clear();
+
+    SpotifySearchCacheStats getStats();
+
+    /** @brief Fraction of searches that were served from RAM, from 0 to 1. */
+    float hitRatio();
+
+    unsigned long ttlMs = SPOTIFY_SEARCH_CACHE_TTL;
+
+private:
+    int lookup(const char *query, SpotifySearchTypeFlags types, int limit);
+    void remove(int index);
+
+    size_t _budget;
+    size_t _used;
+
+    SpotifySearchCacheEntry _entries[SPOTIFY_SEARCH_CACHE_ENTRIES];
+    int _count;
+
+    uint32_t _hits;
+    uint32_t _misses;
+    uint32_t _expired;
+};
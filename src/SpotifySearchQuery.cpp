@@ -0,0 +1,208 @@
+#include "SpotifySearchQuery.h"
+
+static const struct {
+    SpotifySearchTypeFlagBits type;
+    const char *name;
+} searchTypeNames[] = {
+    { SpotifySearchTypeFlagBits::eTrack, "track" },
+    { SpotifySearchTypeFlagBits::eAlbum, "album" },
+    { SpotifySearchTypeFlagBits::eArtist, "artist" },
+    { SpotifySearchTypeFlagBits::ePlaylist, "playlist" },
+};
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+SpotifySearchQuery::SpotifySearchQuery()
+    : SpotifySearchQuery(_storage, sizeof(_storage))
+{
+}
+
+SpotifySearchQuery::SpotifySearchQuery(char *buffer, size_t capacity)
+    : _buffer(buffer)
+    , _capacity(capacity)
+    , _length(0)
+    , _termsStart(0)
+    , _overflow(false)
+{
+    clear();
+}
+
+SpotifySearchQuery& SpotifySearchQuery::text(const char *terms)
+{
+    while (isSpace(*terms))
+        terms++;
+
+    if (!*terms)
+        return *this;
+
+    size_t mark = _length;
+    if (!separate() || !putEncoded(terms))
+        rollback(mark);
+
+    return *this;
+}
+
+SpotifySearchQuery& SpotifySearchQuery::year(int from, int to)
+{
+    char value[12];
+    if (to > from)
+        snprintf(value, sizeof(value), "%d-%d", from, to);
+    else
+        snprintf(value, sizeof(value), "%d", from);
+
+    return field("year", value);
+}
+
+SpotifySearchQuery& SpotifySearchQuery::field(const char *name, const char *value)
+{
+    while (isSpace(*value))
+        value++;
+
+    if (!*value)
+        return *this;
+
+    /* A value of more than one word has to be quoted, or only its first word is the filter. */
+    bool quoted = false;
+    for (const char *c = value; *c; c++)
+        if (isSpace(*c) && c[1] && !isSpace(c[1]))
+            quoted = true;
+
+    size_t mark = _length;
+    bool fits = separate()
+             && putRaw(name)
+             && putRaw("%3A")
+             && (!quoted || putRaw("%22"))
+             && putEncoded(value)
+             && (!quoted || putRaw("%22"));
+
+    if (!fits)
+        rollback(mark);
+
+    return *this;
+}
+
+void SpotifySearchQuery::clear()
+{
+    _length = 0;
+    _overflow = false;
+
+    if (!putRaw(SPOTIFY_SEARCH_ENDPOINT "?q="))
+    {
+        log_e("Search query buffer of %d bytes can't even hold the endpoint", _capacity);
+        rollback(0);
+    }
+
+    _termsStart = _length;
+}
+
+const char* SpotifySearchQuery::terms()
+{
+    _buffer[_length] = '\0';
+    return _buffer + _termsStart;
+}
+
+const char* SpotifySearchQuery::path(SpotifySearchTypeFlags types, int limit, int offset)
+{
+    /* The tail goes after the terms without becoming part of them. */
+    size_t end = _length;
+
+    bool fits = putRaw("&type=");
+
+    bool first = true;
+    for (const auto &searchType : searchTypeNames)
+    {
+        if (!(types & searchType.type))
+            continue;
+
+        fits = fits && (first || put(',')) && putRaw(searchType.name);
+        first = false;
+    }
+
+    char number[24];
+    snprintf(number, sizeof(number), "&limit=%d", limit);
+    fits = fits && putRaw(number);
+
+    if (offset > 0)
+    {
+        snprintf(number, sizeof(number), "&offset=%d", offset);
+        fits = fits && putRaw(number);
+    }
+
+    if (fits)
+        _buffer[_length] = '\0';
+
+    _length = end;
+    return fits ? _buffer : nullptr;
+}
+
+bool SpotifySearchQuery::separate()
+{
+    return empty() || putRaw("%20");
+}
+
+bool SpotifySearchQuery::put(char c)
+{
+    /* Always leave room for the terminator. */
+    if (_length + 1 >= _capacity)
+        return false;
+
+    _buffer[_length++] = c;
+    return true;
+}
+
+bool SpotifySearchQuery::putRaw(const char *text)
+{
+    while (*text)
+        if (!put(*text++))
+            return false;
+
+    return true;
+}
+
+bool SpotifySearchQuery::putEncoded(const char *value)
+{
+    /* One pass, bytes of UTF-8 sequences are escaped one at a time like anything else outside the unreserved set. */
+    bool space = false;
+    bool started = false;
+
+    for (; *value; value++)
+    {
+        uint8_t c = (uint8_t)*value;
+
+        if (isSpace(c))
+        {
+            space = started;
+            continue;
+        }
+
+        if (space && !putRaw("%20"))
+            return false;
+
+        space = false;
+        started = true;
+
+        bool unreserved = isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+        bool fits = unreserved
+            ? put(c)
+            : put('%') && put(hexDigits[c >> 4]) && put(hexDigits[c & 0x0f]);
+
+        if (!fits)
+            return false;
+    }
+
+    return true;
+}
+
+void SpotifySearchQuery::rollback(size_t length)
+{
+    _length = length;
+    _overflow = true;
+
+    if (_capacity > 0)
+        _buffer[_length] = '\0';
+}
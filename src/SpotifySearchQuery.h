@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyConfig.h"
+#include "SpotifyStructs.h"
+
+/** @brief Builds the path of a search request without touching the heap.
+ *
+ * Terms are percent encoded into the buffer as they're added, UTF-8 and all,
+ * with runs of spaces collapsed into one. Field filters narrow the search,
+ * values with spaces in them are quoted. Everything is bounds checked, a
+ * term that doesn't fit is left out whole and @ref ok turns false.
+ *
+ * @code{cpp}
+ * SpotifySearchQuery query;
+ * query.text("get lucky").artist("Daft Punk").year(2013);
+ * spotify.search(query, callbacks);
+ * @endcode
+ *
+ */
+class SpotifySearchQuery {
+public:
+    /** @brief Builds into the object's own buffer of @ref SPOTIFY_SEARCH_PATH_LENGTH. */
+    SpotifySearchQuery();
+
+    /** @brief Builds into a buffer of your own, it must outlive the query. */
+    SpotifySearchQuery(char *buffer, size_t capacity);
+
+    SpotifySearchQuery(const SpotifySearchQuery&) = delete;
+    SpotifySearchQuery& operator=(const SpotifySearchQuery&) = delete;
+
+    /** @brief Adds words to look for anywhere. */
+    SpotifySearchQuery& text(const char *terms);
+
+    /** @brief Only matches items by this artist. */
+    SpotifySearchQuery& artist(const char *name) { return field("artist", name); }
+
+    /** @brief Only matches items on this album. */
+    SpotifySearchQuery& album(const char *name) { return field("album", name); }
+
+    /** @brief Only matches tracks with this name. */
+    SpotifySearchQuery& track(const char *name) { return field("track", name); }
+
+    /** @brief Only matches items released in a year, or from one year to another. */
+    SpotifySearchQuery& year(int from, int to = 0);
+
+    /** @brief Adds any field filter Spotify knows, like "genre" or "isrc". */
+    SpotifySearchQuery& field(const char *name, const char *value);
+
+    /** @brief Starts over with no terms. */
+    void clear();
+
+    /** @brief The encoded terms so far, the value of the q parameter. */
+    const char* terms();
+
+    /** @brief Finishes the request path.
+     *
+     * The types and limit go after the terms, more terms can still be added
+     * afterwards and the path finished again.
+     *
+     * @param[in] types What to search for, see @ref SpotifySearchTypeFlagBits.
+     * @param[in] limit Max results of each type.
+     * @param[in] offset optional, Results to skip, for the next page.
+     *
+     * @return The path, or nullptr on -- it doesn't fit in the buffer.
+     */
+    const char* path(SpotifySearchTypeFlags types, int limit, int offset = 0);
+
+    /** @brief False when a term had to be left out for lack of room. */
+    bool ok() const { return !_overflow; }
+
+    /** @brief Whether any terms were added. */
+    bool empty() const { return _length == _termsStart; }
+
+private:
+    bool separate();
+    bool put(char c);
+    bool putRaw(const char *text);
+    bool putEncoded(const char *value);
+    void rollback(size_t length);
+
+    char *_buffer;
+    size_t _capacity;
+    size_t _length;
+    size_t _termsStart;
+    bool _overflow;
+    char _storage[SPOTIFY_SEARCH_PATH_LENGTH];
+};
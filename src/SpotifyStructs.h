@@ -44,6 +44,13 @@ enum class SpotifyResult : uint32_t
 /* Miscellaneous Errors*/
     eInvalidURL,
     eInvalidImage,
+    eImageBufferTooSmall, /** @brief The image is larger than the buffer it was being read into. */
+    eTimeout, /** @brief The server stopped sending before the response was complete. */
+    eNoMemory, /** @brief A buffer the request needed couldn't be allocated. */
+    eQueryTooLong, /** @brief The search query doesn't fit in its buffer, it wasn't sent. */
+    eDeviceNotFound, /** @brief No device has that name or id, even after fetching the device list again. */
+    eMissingScope, /** @brief The access token wasn't granted a scope the request needs, it wasn't sent. */
+    ePremiumRequired, /** @brief The request needs Spotify Premium and the account doesn't have it. */
 
     eUnknown, /* @brief This error code wasn't accounted for and a github issue or pull request should be created due to its appearance. */
 };
@@ -112,6 +119,64 @@ inline constexpr bool operator==(SpotifyScopeFlags x, SpotifyScopeFlagBits y) {
 inline constexpr bool operator!=(SpotifyScopeFlags x, SpotifyScopeFlagBits y) { return !(x == y); }
 
 
+/** @brief Endpoints that can have their responses compressed. 
+ * 
+ *  Compressed responses are much smaller on the wire but cost a 32KB window
+ *  and some CPU time to inflate, so it's chosen per endpoint.
+ */
+enum class SpotifyEndpointFlagBits : uint32_t
+{
+    eCurrentlyPlaying = (1 << 0), /** @brief @ref SpotifyESP::getCurrentlyPlayingTrack */
+    ePlaybackState = (1 << 1), /** @brief @ref SpotifyESP::getPlaybackState */
+    eDevices = (1 << 2), /** @brief @ref SpotifyESP::getAvailableDevices */
+    eSearch = (1 << 3), /** @brief @ref SpotifyESP::searchForSong and @ref SpotifyESP::search */
+    eCatalog = (1 << 4), /** @brief @ref SpotifyESP::getTracks, @ref SpotifyESP::getAlbums and @ref SpotifyESP::getArtists */
+    eLibrary = (1 << 5), /** @brief Pages of @ref SpotifyESP::getPlaylistTracks, @ref SpotifyESP::getSavedTracks and @ref SpotifyESP::getUserPlaylists */
+    eRecentlyPlayed = (1 << 6), /** @brief @ref SpotifyESP::getRecentlyPlayed */
+    eQueue = (1 << 7), /** @brief @ref SpotifyESP::getQueue */
+
+    eNone = 0x0000000, /** @brief Never ask for compressed responses. */
+    eAll = 0xFFFFFFFF, /** @brief Compress every response that supports it. */
+};
+
+using SpotifyEndpointFlags = uint32_t;
+
+inline constexpr SpotifyEndpointFlags operator&(SpotifyEndpointFlags x, SpotifyEndpointFlagBits y) { return static_cast<SpotifyEndpointFlags>(static_cast<int>(x) & static_cast<int>(y)); }
+inline constexpr SpotifyEndpointFlags operator|(SpotifyEndpointFlags x, SpotifyEndpointFlagBits y) { return static_cast<SpotifyEndpointFlags>(static_cast<int>(x) | static_cast<int>(y)); }
+
+/** @brief Kinds of items a search can look for. 
+ *  @url https://developer.spotify.com/documentation/web-api/reference/search
+ */
+enum class SpotifySearchTypeFlagBits : uint32_t
+{
+    eTrack = (1 << 0),
+    eAlbum = (1 << 1),
+    eArtist = (1 << 2),
+    ePlaylist = (1 << 3),
+
+    eNone = 0x0000000,
+};
+
+using SpotifySearchTypeFlags = uint32_t;
+
+inline constexpr SpotifySearchTypeFlags operator&(SpotifySearchTypeFlags x, SpotifySearchTypeFlagBits y) { return static_cast<SpotifySearchTypeFlags>(static_cast<int>(x) & static_cast<int>(y)); }
+inline constexpr SpotifySearchTypeFlags operator|(SpotifySearchTypeFlags x, SpotifySearchTypeFlagBits y) { return static_cast<SpotifySearchTypeFlags>(static_cast<int>(x) | static_cast<int>(y)); }
+
+/** @brief Running totals of compressed responses, to see what compression saves. */
+struct SpotifyCompressionStats {
+    uint32_t responses; /** @brief Responses that came back compressed. */
+    uint32_t compressedBytes; /** @brief Bytes received on the wire for those responses. */
+    uint32_t decompressedBytes; /** @brief Bytes they inflated to. */
+};
+
+/** @brief How the last image download went. */
+struct SpotifyImageTransferStats {
+    uint32_t bytes;
+    uint32_t durationMs; /** @brief From the first read to the last. */
+    uint32_t bytesPerSecond;
+    uint32_t resumes; /** @brief Times the download dropped and was picked up again. */
+};
+
 /** @brief Authorization code flows, depending on circumstance one is recommended over another.
  * 
  *  @link https://developer.spotify.com/documentation/web-api/concepts/authorization 
@@ -125,6 +190,23 @@ enum class SpotifyCodeFlow {
     /* The other flows are not implemented yet. */
 };
 
+/** @brief What @ref SpotifyCredentialStore keeps between boots. */
+struct SpotifyCredentials {
+    char accessToken[SPOTIFY_ACCESS_TOKEN_LENGTH+1]; /** @brief Without the "Bearer " prefix. */
+    char refreshToken[SPOTIFY_REFRESH_TOKEN_LENGTH+1];
+    int64_t expiresAt; /** @brief Unix time the access token expires, 0 when the clock wasn't set. */
+    SpotifyScopeFlags scopes; /** @brief Those the access token was granted. */
+};
+
+/** @brief The user's subscription level.
+ *  @link https://developer.spotify.com/documentation/web-api/reference/get-current-users-profile
+ */
+enum class SpotifyProduct {
+    eUnknown, /** @brief Not fetched yet, or the token lacks user-read-private. */
+    eFree, /** @brief Free or open, player commands will be refused. */
+    ePremium,
+};
+
 /** @brief Different repeat modes.  
  *  @link https://developer.spotify.com/documentation/web-api/reference/get-the-users-currently-playing-track
  */
@@ -197,6 +279,38 @@ struct SpotifySearchResult {
     int numImages;
 };
 
+/** @brief A track from the catalogue, it has the same fields as a search result. 
+ *  @url https://developer.spotify.com/documentation/web-api/reference/get-several-tracks
+ */
+using SpotifyTrack = SpotifySearchResult;
+
+/** @brief An album on Spotify. 
+ *  @url https://developer.spotify.com/documentation/web-api/reference/get-multiple-albums
+ */
+struct SpotifyAlbum {
+    char albumName[SPOTIFY_NAME_CHAR_LENGTH];
+    char albumUri[SPOTIFY_URI_CHAR_LENGTH];
+    SpotifyArtist artists[SPOTIFY_MAX_NUM_ARTISTS];
+    SpotifyImage albumImages[SPOTIFY_NUM_ALBUM_IMAGES];
+    int numArtists;
+    int numImages;
+    int totalTracks;
+};
+
+/** @brief A playlist the user owns or follows. 
+ *  @url https://developer.spotify.com/documentation/web-api/reference/get-a-list-of-current-users-playlists
+ */
+struct SpotifyPlaylist {
+    char playlistName[SPOTIFY_NAME_CHAR_LENGTH];
+    char playlistUri[SPOTIFY_URI_CHAR_LENGTH];
+    char playlistId[SPOTIFY_ID_CHAR_LENGTH];
+    char snapshotId[SPOTIFY_SNAPSHOT_ID_CHAR_LENGTH]; /** @brief Changes whenever the playlist does. */
+    char ownerName[SPOTIFY_NAME_CHAR_LENGTH];
+    SpotifyImage images[SPOTIFY_NUM_ALBUM_IMAGES];
+    int numImages;
+    int totalTracks;
+};
+
 /** @brief Retrieves results from the currently playing track. 
  *  @url https://developer.spotify.com/documentation/web-api/reference/get-the-users-currently-playing-track
  */
@@ -216,7 +330,52 @@ struct SpotifyCurrentlyPlaying {
     SpotifyPlayingType currentlyPlayingType;
 };
 
+/** @brief A compact record of one item in the user's queue, a track or an episode. 
+ *  @url https://developer.spotify.com/documentation/web-api/reference/get-queue
+ */
+struct SpotifyQueueItem {
+    char name[SPOTIFY_NAME_CHAR_LENGTH];
+    char uri[SPOTIFY_URI_CHAR_LENGTH];
+    char artistName[SPOTIFY_NAME_CHAR_LENGTH]; /** @brief The first artist, or the show for episodes. */
+    char imageUrl[SPOTIFY_URL_CHAR_LENGTH]; /** @brief The cover picked by @ref SpotifyESP::selectImage. */
+    long durationMs;
+    SpotifyPlayingType type;
+};
+
+/** @brief How a queue item compares with the last time the queue was fetched. */
+enum class SpotifyQueueChange {
+    eUnchanged, /** @brief The same item is still in this row. */
+    eMoved, /** @brief The item was queued before, in another row. */
+    eAdded, /** @brief The item wasn't queued before. */
+};
+
+/** @brief What changed in the queue since it was last fetched. */
+struct SpotifyQueueDiff {
+    int count; /** @brief Items queued now, not counting the one playing. */
+    int added;
+    int moved;
+    int removed; /** @brief Items that were queued before and aren't anymore. */
+    bool currentChanged; /** @brief Something else is playing. */
+};
+
 using SpotifyCallbackOnCurrentlyPlaying = std::function<void(SpotifyCurrentlyPlaying currentlyPlaying)>;
 using SpotifyCallbackOnPlaybackState = std::function<void(SpotifyPlayerDetails playerDetails)>;
 using SpotifyCallbackOnDevices = std::function<bool(SpotifyDevice device, int index, int numDevices)>;
 using SpotifyCallbackOnSearch = std::function<bool(SpotifySearchResult result, int index, int numResults)>;
+using SpotifyCallbackOnTrack = std::function<bool(SpotifyTrack track, int index, int numTracks)>;
+using SpotifyCallbackOnAlbum = std::function<bool(SpotifyAlbum album, int index, int numAlbums)>;
+using SpotifyCallbackOnArtist = std::function<bool(SpotifyArtist artist, int index, int numArtists)>;
+using SpotifyCallbackOnPlaylist = std::function<bool(SpotifyPlaylist playlist, int index, int numPlaylists)>;
+using SpotifyCallbackOnRecentlyPlayed = std::function<bool(SpotifyTrack track, uint64_t playedAtMs, int index, int numTracks)>;
+using SpotifyCallbackOnQueue = std::function<bool(SpotifyQueueItem item, int index, SpotifyQueueChange change)>;
+
+/** @brief Where the results of @ref SpotifyESP::search go, only the types with a callback are searched for. */
+struct SpotifySearchCallbacks {
+    SpotifyCallbackOnTrack onTrack;
+    SpotifyCallbackOnAlbum onAlbum;
+    SpotifyCallbackOnArtist onArtist;
+    SpotifyCallbackOnPlaylist onPlaylist;
+};
+
+/** @brief Receives an image a chunk at a time, return false to stop reading. The data is only valid during the call. */
+using SpotifyCallbackOnImageData = std::function<bool(const uint8_t *data, size_t length)>;
@@ -0,0 +1,135 @@
+#include "SpotifyThumbnail.h"
+#include "SpotifyImageCache.h"
+
+uint32_t SpotifyThumbnail::key(const char *url, int width, int height)
+{
+    /* Carries on the FNV-1a of the URL, so no URL is too long to tell sizes apart. */
+    uint32_t hash = SpotifyImageCache::hash(url);
+    for (uint32_t value : { (uint32_t)width, (uint32_t)height })
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 16777619u;
+        }
+    }
+
+    return hash;
+}
+
+#if SPOTIFY_HAS_JPEG_DECODER
+
+/* Work area TJpgDec needs for its tables, 3100 bytes is its documented minimum. */
+#define SPOTIFY_JPEG_POOL_SIZE 3100
+
+/* Handed to the decoder callbacks through JDEC::device. */
+struct SpotifyThumbnailDecode {
+    const uint8_t *jpeg;
+    size_t length;
+    size_t position;
+    uint16_t *framebuffer;
+    int width;
+    int height;
+    int scaledWidth;
+    int scaledHeight;
+};
+
+static UINT readJpeg(JDEC *decoder, BYTE *buffer, UINT length)
+{
+    SpotifyThumbnailDecode *decode = (SpotifyThumbnailDecode*)decoder->device;
+
+    length = min((size_t)length, decode->length - decode->position);
+    if (buffer)
+        memcpy(buffer, decode->jpeg + decode->position, length);
+
+    decode->position += length;
+    return length;
+}
+
+static UINT writePixels(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    SpotifyThumbnailDecode *decode = (SpotifyThumbnailDecode*)decoder->device;
+    const uint8_t *rgb = (const uint8_t*)bitmap;
+    int rectWidth = rect->right - rect->left + 1;
+
+    /* The target pixels whose nearest source pixel falls in this block, works for up and down scaling. */
+    int firstX = (rect->left * decode->width + decode->scaledWidth - 1) / decode->scaledWidth;
+    int endX = ((rect->right + 1) * decode->width + decode->scaledWidth - 1) / decode->scaledWidth;
+    int firstY = (rect->top * decode->height + decode->scaledHeight - 1) / decode->scaledHeight;
+    int endY = ((rect->bottom + 1) * decode->height + decode->scaledHeight - 1) / decode->scaledHeight;
+
+    for (int y = firstY; y < endY && y < decode->height; y++)
+    {
+        int sourceY = y * decode->scaledHeight / decode->height - rect->top;
+        uint16_t *row = decode->framebuffer + y * decode->width;
+
+        for (int x = firstX; x < endX && x < decode->width; x++)
+        {
+            int sourceX = x * decode->scaledWidth / decode->width - rect->left;
+            const uint8_t *pixel = rgb + (sourceY * rectWidth + sourceX) * 3;
+            row[x] = ((pixel[0] & 0xF8) << 8) | ((pixel[1] & 0xFC) << 3) | (pixel[2] >> 3);
+        }
+    }
+
+    return 1;
+}
+
+bool SpotifyThumbnail::decode(const uint8_t *jpeg, size_t length, uint16_t *framebuffer, int width, int height)
+{
+    if (!jpeg || !framebuffer || width <= 0 || height <= 0)
+        return false;
+
+    void *pool = malloc(SPOTIFY_JPEG_POOL_SIZE);
+    if (!pool)
+    {
+        log_e("Not enough memory to decode the image");
+        return false;
+    }
+
+    SpotifyThumbnailDecode decode = {};
+    decode.jpeg = jpeg;
+    decode.length = length;
+    decode.framebuffer = framebuffer;
+    decode.width = width;
+    decode.height = height;
+
+    JDEC decoder;
+    JRESULT result = jd_prepare(&decoder, readJpeg, pool, SPOTIFY_JPEG_POOL_SIZE, &decode);
+    if (result != JDR_OK)
+    {
+        log_e("Can't decode the image: %d", result);
+        free(pool);
+        return false;
+    }
+
+    /* The smallest decode that still covers the target, scale is a power of two divisor. */
+    uint8_t scale = 0;
+    while (scale < 3 && (int)(decoder.width >> (scale + 1)) >= width && (int)(decoder.height >> (scale + 1)) >= height)
+        scale++;
+
+    decode.scaledWidth = (decoder.width + (1 << scale) - 1) >> scale;
+    decode.scaledHeight = (decoder.height + (1 << scale) - 1) >> scale;
+
+    log_d("Decoding %dx%d at 1/%d to %dx%d", decoder.width, decoder.height, 1 << scale, width, height);
+
+    result = jd_decomp(&decoder, writePixels, scale);
+    free(pool);
+
+    if (result != JDR_OK)
+    {
+        log_e("Decoding the image failed: %d", result);
+        return false;
+    }
+
+    return true;
+}
+
+#else
+
+bool SpotifyThumbnail::decode(const uint8_t *jpeg, size_t length, uint16_t *framebuffer, int width, int height)
+{
+    log_e("Can't decode images on this chip");
+    return false;
+}
+
+#endif
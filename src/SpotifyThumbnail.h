@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "SpotifyConfig.h"
+
+#if __has_include(<rom/tjpgd.h>)
+#include <rom/tjpgd.h>
+#define SPOTIFY_HAS_JPEG_DECODER 1
+#elif __has_include(<esp32/rom/tjpgd.h>)
+#include <esp32/rom/tjpgd.h>
+#define SPOTIFY_HAS_JPEG_DECODER 1
+#elif __has_include(<esp32s3/rom/tjpgd.h>)
+#include <esp32s3/rom/tjpgd.h>
+#define SPOTIFY_HAS_JPEG_DECODER 1
+#elif __has_include(<esp32c3/rom/tjpgd.h>)
+#include <esp32c3/rom/tjpgd.h>
+#define SPOTIFY_HAS_JPEG_DECODER 1
+#else
+#define SPOTIFY_HAS_JPEG_DECODER 0 // No decoder in ROM, thumbnails can only come from the cache
+#endif
+
+/** @brief Decodes album art straight to a display's pixel format.
+ *
+ * Uses the TJpgDec decoder that lives in the ESP32's ROM. The JPEG is
+ * decoded at the largest 1/1, 1/2, 1/4 or 1/8 scale that still covers the
+ * target size, then sampled to exactly that size as RGB565, the format most
+ * SPI TFTs take. Only baseline JPEGs can be decoded, which is what Spotify
+ * serves.
+ *
+ */
+class SpotifyThumbnail {
+public:
+    /** @brief Whether this chip has a decoder. */
+    static bool canDecode() { return SPOTIFY_HAS_JPEG_DECODER; }
+
+    /** @brief Decodes and scales a JPEG into an RGB565 framebuffer.
+     *
+     * @param[in] jpeg The whole JPEG file.
+     * @param[in] length Size of the JPEG in bytes.
+     * @param[out] framebuffer Receives width * height pixels, row by row.
+     * @param[in] width Width of the framebuffer in pixels.
+     * @param[in] height Height of the framebuffer in pixels.
+     *
+     * @return True on -- the image was decoded.
+     */
+    static bool decode(const uint8_t *jpeg, size_t length, uint16_t *framebuffer, int width, int height);
+
+    /** @brief Key a thumbnail is cached under, the hash of its URL with the size mixed in.
+     *
+     * @param[in] url The URL of the JPEG it was decoded from.
+     * @param[in] width Width of the thumbnail in pixels.
+     * @param[in] height Height of the thumbnail in pixels.
+     */
+    static uint32_t key(const char *url, int width, int height);
+
+    /** @brief The size of an RGB565 framebuffer in bytes. */
+    static size_t framebufferSize(int width, int height) { return (size_t)width * height * sizeof(uint16_t); }
+};